@@ -13,11 +13,23 @@ char * remove$s(char * operand);
 #define ADD 0
 #define SUB 1
 #define LWR 2
+#define MUL 3
+#define AND 4
 #define ADDI 5
+#define OR  6
+#define XOR 7
 #define LW  8
 #define SW  9
+#define SLT 10
+#define SWR 11
 #define BEQ 12
+#define BNE 13
 #define J   15
+#define SLL 16
+#define SRL 17
+#define VLW 20
+#define VSW 21
+#define VADD 22
 
 /* each has to be exactly 32-bit in total */
 struct AnyInstruction {
@@ -35,6 +47,9 @@ struct AnyInstruction {
  *
  * "add, rd, rs, rt"
  * "sub, rd, rs, rt".
+ * mul, and, or, xor and slt ("slt, rd, rs, rt" sets rd to 1 if rs < rt, signed) use the same format.
+ * "vadd, vd, vs, vt" adds the 4-word vector registers vs and vt ($v0-$v7) into vd, in the same format.
+ * "lwr, rd, rs, rt" loads rd from the register-indexed address rs+rt, "swr, rd, rs, rt" stores rd to rs+rt.
  */
 struct RTypeALUInstruction {
     unsigned int unused:11;
@@ -52,6 +67,11 @@ struct RTypeALUInstruction {
  * sw   is written as "sw,   rt, rs, imm" in the source code. rt is the register that supplies data to the memory
  * beq  is written as "beq,  rt, rs, imm" in the source code.
  * addi is written as "addi, rt, rs, imm" in the source code. rt is the destination register for the result
+ * bne  is written as "bne,  rt, rs, imm" in the source code, like beq.
+ * sll  is written as "sll,  rt, rs, imm" in the source code. rt gets rs shifted left by imm bits
+ * srl  is written as "srl,  rt, rs, imm" in the source code. rt gets rs shifted right (logical) by imm bits
+ * vlw  is written as "vlw,  vt, rs, imm" in the source code. vector register vt gets the 4 words at rs+imm
+ * vsw  is written as "vsw,  vt, rs, imm" in the source code. vector register vt is stored to the 4 words at rs+imm
  */
 struct ITypeInstruction {
     int Imm:16;
@@ -85,6 +105,30 @@ int assembler(char * instruction) {
     } else if (strcasecmp(func, "SUB")==0) {
         rtypeALU.func = SUB;
         isRType = 1;
+    } else if (strcasecmp(func, "MUL")==0) {
+        rtypeALU.func = MUL;
+        isRType = 1;
+    } else if (strcasecmp(func, "AND")==0) {
+        rtypeALU.func = AND;
+        isRType = 1;
+    } else if (strcasecmp(func, "OR")==0) {
+        rtypeALU.func = OR;
+        isRType = 1;
+    } else if (strcasecmp(func, "XOR")==0) {
+        rtypeALU.func = XOR;
+        isRType = 1;
+    } else if (strcasecmp(func, "SLT")==0) {
+        rtypeALU.func = SLT;
+        isRType = 1;
+    } else if (strcasecmp(func, "VADD")==0) {
+        rtypeALU.func = VADD;
+        isRType = 1;
+    } else if (strcasecmp(func, "LWR")==0) {
+        rtypeALU.func = LWR;
+        isRType = 1;
+    } else if (strcasecmp(func, "SWR")==0) {
+        rtypeALU.func = SWR;
+        isRType = 1;
     } else if (strcasecmp(func, "LW")==0) {
         itypeLWSWBEQADDI.func = LW;
         isIType = 1;
@@ -94,9 +138,24 @@ int assembler(char * instruction) {
     } else if (strcasecmp(func, "BEQ")==0) {
         itypeLWSWBEQADDI.func = BEQ;
         isIType = 1;
+    } else if (strcasecmp(func, "BNE")==0) {
+        itypeLWSWBEQADDI.func = BNE;
+        isIType = 1;
     } else if (strcasecmp(func, "ADDI")==0) {
         itypeLWSWBEQADDI.func = ADDI;
         isIType = 1;
+    } else if (strcasecmp(func, "SLL")==0) {
+        itypeLWSWBEQADDI.func = SLL;
+        isIType = 1;
+    } else if (strcasecmp(func, "SRL")==0) {
+        itypeLWSWBEQADDI.func = SRL;
+        isIType = 1;
+    } else if (strcasecmp(func, "VLW")==0) {
+        itypeLWSWBEQADDI.func = VLW;
+        isIType = 1;
+    } else if (strcasecmp(func, "VSW")==0) {
+        itypeLWSWBEQADDI.func = VSW;
+        isIType = 1;
     } else if (strcasecmp(func, "J")==0) {
         jump.func = J;
         isJump = 1;
@@ -156,7 +215,15 @@ void decoder(int instrWord, char *func, char * RsSelect, char * RtSelect, char *
     struct AnyInstruction instr = *(struct AnyInstruction*) &instrWord;
     switch (instr.func) {
         case ADD:
-        case SUB: {
+        case SUB:
+        case MUL:
+        case AND:
+        case OR:
+        case XOR:
+        case SLT:
+        case LWR:
+        case SWR:
+        case VADD: {
             struct RTypeALUInstruction rtypeALU = *(struct RTypeALUInstruction *) &instrWord;
             *func = rtypeALU.func;
             *RsSelect = rtypeALU.Rs;
@@ -167,7 +234,12 @@ void decoder(int instrWord, char *func, char * RsSelect, char * RtSelect, char *
         case LW:
         case SW:
         case BEQ:
+        case BNE:
         case ADDI:
+        case SLL:
+        case SRL:
+        case VLW:
+        case VSW:
         {
             struct ITypeInstruction lwSWBEQ = *(struct ITypeInstruction *) &instrWord;
             *func = lwSWBEQ.func;
@@ -202,6 +274,24 @@ void disassembler (int instrWord) {
             printf("\t0x%08x: %s, $s%d, $s%d, $s%d\n", instrWord, funcName, rtypeALU.Rd, rtypeALU.Rs, rtypeALU.Rt);
             break;
         }
+        case MUL:
+        case AND:
+        case OR:
+        case XOR:
+        case SLT: {
+            funcName = instr.func == MUL ? "MUL" : instr.func == AND ? "AND" : instr.func == OR ? "OR" :
+                       instr.func == XOR ? "XOR" : "SLT";
+            struct RTypeALUInstruction rtypeALU = *(struct RTypeALUInstruction *) &instrWord;
+            printf("\t0x%08x: %s, $s%d, $s%d, $s%d\n", instrWord, funcName, rtypeALU.Rd, rtypeALU.Rs, rtypeALU.Rt);
+            break;
+        }
+        case LWR:
+        case SWR: {
+            funcName = instr.func == LWR ? "LWR" : "SWR";
+            struct RTypeALUInstruction rtypeALU = *(struct RTypeALUInstruction *) &instrWord;
+            printf("\t0x%08x: %s, $s%d, $s%d, $s%d\n", instrWord, funcName, rtypeALU.Rd, rtypeALU.Rs, rtypeALU.Rt);
+            break;
+        }
         case LW: {
             funcName = "LW";
             struct ITypeInstruction lwSWBEQ = *(struct ITypeInstruction *) &instrWord;
@@ -221,6 +311,35 @@ void disassembler (int instrWord) {
             printf("\t0x%08x: %s, $s%d, $s%d, %d\n", instrWord, funcName, lwSWBEQ.Rt, lwSWBEQ.Rs, lwSWBEQ.Imm);
             break;
         }
+        case BNE:
+        {
+            funcName = "BNE";
+            struct ITypeInstruction lwSWBEQ = *(struct ITypeInstruction *) &instrWord;
+            printf("\t0x%08x: %s, $s%d, $s%d, %d\n", instrWord, funcName, lwSWBEQ.Rt, lwSWBEQ.Rs, lwSWBEQ.Imm);
+            break;
+        }
+        case SLL:
+        case SRL:
+        {
+            funcName = instr.func == SLL ? "SLL" : "SRL";
+            struct ITypeInstruction lwSWBEQ = *(struct ITypeInstruction *) &instrWord;
+            printf("\t0x%08x: %s, $s%d, $s%d, %d\n", instrWord, funcName, lwSWBEQ.Rt, lwSWBEQ.Rs, lwSWBEQ.Imm);
+            break;
+        }
+        case VADD: {
+            funcName = "VADD";
+            struct RTypeALUInstruction rtypeALU = *(struct RTypeALUInstruction *) &instrWord;
+            printf("\t0x%08x: %s, $v%d, $v%d, $v%d\n", instrWord, funcName, rtypeALU.Rd, rtypeALU.Rs, rtypeALU.Rt);
+            break;
+        }
+        case VLW:
+        case VSW:
+        {
+            funcName = instr.func == VLW ? "VLW" : "VSW";
+            struct ITypeInstruction lwSWBEQ = *(struct ITypeInstruction *) &instrWord;
+            printf("\t0x%08x: %s, $v%d, $s%d, %d\n", instrWord, funcName, lwSWBEQ.Rt, lwSWBEQ.Rs, lwSWBEQ.Imm);
+            break;
+        }
         case ADDI:
         {
             funcName = "ADDI";
@@ -259,21 +378,32 @@ int main(int argc, char * argv[]) {
     char binFileName[strlen(argv[1])+8];
     sprintf(binFileName, "%s%s", argv[1], ".bin\0");
     FILE *binFile = fopen(binFileName, "w");
+    /* the line map records the source line of each instruction word, the simulator uses it for profiles */
+    char mapFileName[strlen(argv[1])+16];
+    sprintf(mapFileName, "%s%s", argv[1], ".bin.map");
+    FILE *mapFile = fopen(mapFileName, "w");
+    int lineNo = 0;
+    int numInstr = 0;
     while (fgets(lingBuffer, MAXCHAR, srcFile) != NULL) {
         char * ptr = lingBuffer;
+        lineNo++;
         /* ignore comment line which starts with #, and blank line. */
         while(*ptr==' ' || *ptr=='\t') ptr++; // skip whitespaces
         if (*ptr == '#') continue; /* comment line, continue */
         if(*ptr=='\r' || *ptr=='\n') continue;
 
         printf("%s", ptr);
+        fprintf(mapFile, "%d %d %s", numInstr, lineNo, ptr);
+        if (ptr[strlen(ptr)-1] != '\n') fprintf(mapFile, "\n");
 
         int iw = assembler(ptr);
         fprintf(binFile, "%08x\n", iw);
         disassembler(iw);
+        numInstr++;
     }
     fclose(srcFile);
     fclose(binFile);
+    fclose(mapFile);
     return 0;
 }
 
@@ -301,13 +431,14 @@ char *removeWhite(char *str)
 }
 
 /**
- * This function remove the leading $s of an operand and it should return a string of a pure number
+ * This function remove the leading $s (or $v for a vector register) of an operand and it should return
+ * a string of a pure number
  * @param operand
  * @return
  */
 char * remove$s(char * operand) {
     short index = 0;
-    while(operand[index] == '$' || operand[index] == 's')
+    while(operand[index] == '$' || operand[index] == 's' || operand[index] == 'v')
     {
         index++;
     }
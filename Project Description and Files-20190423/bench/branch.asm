@@ -0,0 +1,22 @@
+# Benchmark kernel: data dependent branches (workload branch)
+# for (i=0; i != N; i++)
+#    A[i] = B[i] & 1 ? 3*B[i] + 1 : B[i] >> 1;
+# B is random, so the branch goes either way at random.
+# The address of A and B are in $s1 and $s2, N is read from $s4: run with --n N --reg 4=N.
+
+SLL,  $s12, $s4, 2           # instruction #0, N*4
+ADDI, $s3, $s0, 0            # 1, i*4 = 0
+ADDI, $s13, $s0, 1           # 2, the constant 1
+# loop label:   which is instruction 3
+LWR,  $s6, $s2, $s3          # 3, B[i]
+AND,  $s7, $s6, $s13         # 4, B[i] & 1
+BEQ,  $s7, $s0, 4            # 5, even, go to instruction 10
+ADD,  $s8, $s6, $s6          # 6, 2*B[i]
+ADD,  $s8, $s8, $s6          # 7, 3*B[i]
+ADDI, $s8, $s8, 1            # 8, 3*B[i] + 1
+J, 11                        # 9, go to the store
+SRL,  $s8, $s6, 1            # 10, B[i] >> 1
+SWR,  $s8, $s1, $s3          # 11, A[i] stored the result
+ADDI, $s3, $s3, 4            # 12, i++
+BNE,  $s3, $s12, -11         # 13, back to the loop (instruction 3) while i != N
+J, 999999                    # 14, terminate the program
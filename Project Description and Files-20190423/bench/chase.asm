@@ -0,0 +1,18 @@
+# Benchmark kernel: pointer chase (workload chase)
+# p = 0;
+# for (k=0; k != N; k++) {
+#    A[k] = p;
+#    p = B[p/4];
+# }
+# B holds a random cycle of byte offsets, set up by the workload, so every load depends on the previous one.
+# The address of A and B are in $s1 and $s2, N is read from $s4: run with --n N --reg 4=N.
+
+ADDI, $s5, $s0, 0            # instruction #0, p = 0
+SLL,  $s12, $s4, 2           # 1, N*4
+ADDI, $s3, $s0, 0            # 2, k*4 = 0
+# loop label:   which is instruction 3
+SWR,  $s5, $s1, $s3          # 3, A[k] = p
+LWR,  $s5, $s2, $s5          # 4, p = B[p/4], p is a byte offset
+ADDI, $s3, $s3, 4            # 5, k++
+BNE,  $s3, $s12, -4          # 6, back to the loop (instruction 3) while k != N
+J, 999999                    # 7, terminate the program
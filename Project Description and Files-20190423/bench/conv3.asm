@@ -0,0 +1,20 @@
+# Benchmark kernel: 1-D convolution (workload conv3), test_lwr.asm with N read from $s4
+# for (i=1; i != N-2; i++)
+#    A[i] = B[i-1] + B[i] + B[i+1];
+# The address of A and B are in $s1 and $s2, N is read from $s4: run with --n N --reg 4=N.
+
+ADDI, $s3, $s0, 4            # instruction #0, i*4 with i = 1
+ADDI, $s12, $s4, -2          # 1, N-2
+SLL,  $s12, $s12, 2          # 2, (N-2)*4, the loop ends when $s3 gets there
+ADDI, $s5, $s2, -4           # 3, &B[-1] is now in $s5
+ADDI, $s6, $s2, 4            # 4, &B[1] is now in $s6
+# loop label:   which is instruction 5
+LWR,  $s7, $s5, $s3          # 5,  B[i-1] is now in $s7
+LWR,  $s8, $s2, $s3          # 6,  B[i] is now in $s8
+LWR,  $s9, $s6, $s3          # 7,  B[i+1] is now in $s9
+ADD,  $s10, $s7, $s8         # 8,  B[i-1] + B[i]
+ADD,  $s10, $s9, $s10        # 9,  B[i-1] + B[i] + B[i+1]
+SWR,  $s10, $s1, $s3         # 10, A[i] stored the result
+ADDI, $s3, $s3, 4            # 11, i++
+BNE,  $s3, $s12, -8          # 12, back to the loop (instruction 5) while i != N-2
+J, 999999                    # 13, terminate the program
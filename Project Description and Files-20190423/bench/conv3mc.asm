@@ -0,0 +1,40 @@
+# Benchmark kernel: conv3 (workload conv3) split between the cores of --cores
+# for (i = first; i < N-2; i += step)
+#    A[i] = B[i-1] + B[i] + B[i+1];
+# Core $s30 of $s31 takes either every $s31-th i from 1+$s30 on (interleaved, $s14 = 0), or the $s14
+# consecutive i from 1 + $s30*$s14 on (blocked, $s14 = chunk, the last core stops at N-2). Interleaved,
+# neighbouring cores write neighbouring words of A, in the same cache block: false sharing.
+# The address of A and B are in $s1 and $s2, N is read from $s4: run with --n N --reg 4=N [--reg 14=chunk].
+
+ADDI, $s12, $s4, -2          # instruction #0, end = N-2
+BEQ,  $s14, $s0, 8           # 1, chunk 0: interleaved (instruction 10)
+MUL,  $s3, $s30, $s14        # 2, core*chunk
+ADDI, $s3, $s3, 1            # 3, first = 1 + core*chunk
+ADD,  $s13, $s3, $s14        # 4, first + chunk
+SLT,  $s15, $s13, $s12       # 5, first + chunk < N-2 ?
+BEQ,  $s15, $s0, 1           # 6, no: the block ends at N-2
+ADD,  $s12, $s13, $s0        # 7, end = first + chunk
+ADDI, $s16, $s0, 1           # 8, step = 1
+J, 12                        # 9
+# interleaved:  which is instruction 10
+ADDI, $s3, $s30, 1           # 10, first = 1 + core
+ADD,  $s16, $s31, $s0        # 11, step = cores
+# instruction 12
+SLL,  $s3, $s3, 2            # 12, i*4
+SLL,  $s12, $s12, 2          # 13, end*4
+SLL,  $s16, $s16, 2          # 14, step*4
+ADDI, $s5, $s2, -4           # 15, &B[-1] is now in $s5
+ADDI, $s6, $s2, 4            # 16, &B[1] is now in $s6
+SLT,  $s15, $s3, $s12        # 17, does this core have any i?
+BEQ,  $s15, $s0, 9           # 18, no: done (instruction 28)
+# loop label:   which is instruction 19
+LWR,  $s7, $s5, $s3          # 19, B[i-1] is now in $s7
+LWR,  $s8, $s2, $s3          # 20, B[i] is now in $s8
+LWR,  $s9, $s6, $s3          # 21, B[i+1] is now in $s9
+ADD,  $s10, $s7, $s8         # 22, B[i-1] + B[i]
+ADD,  $s10, $s9, $s10        # 23, B[i-1] + B[i] + B[i+1]
+SWR,  $s10, $s1, $s3         # 24, A[i] stored the result
+ADD,  $s3, $s3, $s16         # 25, i += step
+SLT,  $s15, $s3, $s12        # 26, i < end ?
+BNE,  $s15, $s0, -9          # 27, back to the loop (instruction 19)
+J, 999999                    # 28, terminate the program
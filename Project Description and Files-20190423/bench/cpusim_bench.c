@@ -0,0 +1,352 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+ * Benchmark harness for the simulator. Runs every combination of workload, problem size, engine and data
+ * cache configuration as a separate cpusim_cachesim process with the trace off, and reports for each run
+ * the instruction count, the host MIPS of the simulation loop, the wall and CPU time of the whole process
+ * and its peak RSS, as CSV or JSON. With --baseline, the MIPS of every run is compared with an earlier CSV
+ * report and the harness fails if any run got slower than the tolerance allows.
+ *
+ * Build:   the cpusim_bench target of the CMake build, next to cpusim_cachesim
+ * Example: build/cpusim_bench --sim build/cpusim_cachesim --kernels bench --sizes 256,65536 --output today.csv
+ *          build/cpusim_bench --sim build/cpusim_cachesim --kernels bench --sizes 256,65536 --baseline today.csv
+ *
+ * The kernels are <kernels>/<workload>.asm.bin, they read N from $s4 so the harness runs them with
+ * --n N --reg 4=N.
+ */
+
+#define MAX_ITEMS 32
+#define MAX_RESULTS 4096
+#define OUTPUT_BYTES 65536
+
+struct BenchResult {
+    char workload[32];
+    long n;
+    char engine[16];
+    char dcache[32];
+    long long instructions;
+    double simSeconds;               // the simulation loop alone, as reported by the simulator
+    double wallSeconds;              // the whole process: loading, init, simulation and verification
+    double userSeconds;
+    double mips;                     // instructions / simSeconds / 1e6
+    long maxRSSKB;
+    int verified;
+};
+
+struct BenchResult Results[MAX_RESULTS];
+int NumResults = 0;
+
+char SimPath[PATH_MAX] = "../cpusim_cachesim";
+char KernelDir[PATH_MAX] = ".";
+char *WorkloadList[MAX_ITEMS], *SizeList[MAX_ITEMS], *EngineList[MAX_ITEMS], *CacheList[MAX_ITEMS];
+int NumWorkloads, NumSizes, NumEngines, NumCaches;
+int Repeat = 1;
+
+/**
+ * Split a comma separated list in place.
+ * @return the number of items, 0 if there are more than MAX_ITEMS
+ */
+int splitList(char *list, char **items) {
+    int n = 0;
+    char *item = strtok(list, ",");
+    while (item != NULL) {
+        if (n == MAX_ITEMS) return 0;
+        items[n++] = item;
+        item = strtok(NULL, ",");
+    }
+    return n;
+}
+
+/**
+ * Pick the verification result and the instruction count out of complete lines of the simulator's output.
+ * @param executed set to 1 once the "Executed N instructions in S seconds" line has been seen
+ */
+void scanOutput(const char *text, struct BenchResult *result, int *executed) {
+    const char *line = text;
+    while (*line) {
+        const char *end = strchr(line, '\n');
+        size_t length = end != NULL ? (size_t)(end - line) : strlen(line);
+        if (sscanf(line, "Executed %lld instructions in %lf seconds", &result->instructions, &result->simSeconds) == 2) {
+            *executed = 1;
+        }
+        for (size_t k = 0; k + 19 <= length; k++) {
+            if (strncmp(line + k, "Verification Passed", 19) == 0) result->verified = 1;
+        }
+        line += length + (end != NULL);
+    }
+}
+
+/**
+ * Run the simulator once and fill in the result. The child runs in a scratch directory so that its
+ * cpusim_trace.txt does not land in the current one, its stdout comes back through a pipe.
+ * @return 1 on success, 0 if the simulator could not be run or did not report its instruction count
+ */
+int runOnce(const char *workload, long n, const char *engine, const char *dcache, const char *scratchDir,
+            struct BenchResult *result) {
+    char bin[PATH_MAX + 64], nArg[32], regArg[48];
+    snprintf(bin, sizeof(bin), "%s/%s.asm.bin", KernelDir, workload);
+    snprintf(nArg, sizeof(nArg), "%ld", n);
+    snprintf(regArg, sizeof(regArg), "4=%ld", n);
+    const char *argv[] = { SimPath, bin, "--workload", workload, "--n", nArg, "--reg", regArg, "--engine", engine,
+                           "--trace", "0", NULL, NULL, NULL };
+    if (strcmp(dcache, "default") != 0) {
+        argv[12] = "--dcache";
+        argv[13] = dcache;
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return 0;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 0;
+    }
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        if (chdir(scratchDir) != 0) _exit(126);
+        execv(SimPath, (char * const *)argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    memset(result, 0, sizeof(*result));
+    char output[OUTPUT_BYTES];
+    size_t used = 0;
+    ssize_t got;
+    int executed = 0;
+    while ((got = read(fds[0], output + used, sizeof(output) - 1 - used)) > 0) {
+        used += got;
+        if (used == sizeof(output) - 1) {
+            /* full: scan the complete lines and keep the one still being read */
+            output[used] = '\0';
+            char *tail = strrchr(output, '\n');
+            tail = tail != NULL ? tail + 1 : output + used;
+            char next = *tail;
+            *tail = '\0';
+            scanOutput(output, result, &executed);
+            *tail = next;
+            used -= tail - output;
+            memmove(output, tail, used);
+        }
+    }
+    output[used] = '\0';
+    scanOutput(output, result, &executed);
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    snprintf(result->workload, sizeof(result->workload), "%s", workload);
+    result->n = n;
+    snprintf(result->engine, sizeof(result->engine), "%s", engine);
+    snprintf(result->dcache, sizeof(result->dcache), "%s", dcache);
+    result->wallSeconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1e-9;
+    result->userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec*1e-6;
+    result->maxRSSKB = usage.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !executed) {
+        printf("%s %s --n %ld --engine %s --dcache %s failed:\n%s\n", SimPath, bin, n, engine, dcache, output);
+        return 0;
+    }
+    result->mips = result->simSeconds > 0 ? result->instructions/result->simSeconds/1e6 : 0;
+    return 1;
+}
+
+void writeCSV(FILE *out) {
+    int r;
+    fprintf(out, "workload,n,engine,dcache,instructions,sim_seconds,wall_seconds,user_seconds,mips,max_rss_kb,verified\n");
+    for (r = 0; r < NumResults; r++) {
+        struct BenchResult *b = &Results[r];
+        fprintf(out, "%s,%ld,%s,%s,%lld,%.6f,%.6f,%.6f,%.2f,%ld,%d\n", b->workload, b->n, b->engine, b->dcache,
+                b->instructions, b->simSeconds, b->wallSeconds, b->userSeconds, b->mips, b->maxRSSKB, b->verified);
+    }
+}
+
+void writeJSON(FILE *out) {
+    int r;
+    fprintf(out, "[\n");
+    for (r = 0; r < NumResults; r++) {
+        struct BenchResult *b = &Results[r];
+        fprintf(out, "  {\"workload\": \"%s\", \"n\": %ld, \"engine\": \"%s\", \"dcache\": \"%s\", \"instructions\": %lld, "
+                "\"sim_seconds\": %.6f, \"wall_seconds\": %.6f, \"user_seconds\": %.6f, \"mips\": %.2f, "
+                "\"max_rss_kb\": %ld, \"verified\": %s}%s\n", b->workload, b->n, b->engine, b->dcache, b->instructions,
+                b->simSeconds, b->wallSeconds, b->userSeconds, b->mips, b->maxRSSKB, b->verified ? "true" : "false",
+                r + 1 < NumResults ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+/**
+ * Compare the MIPS of this run with a CSV report of an earlier one. Runs that are not in the baseline are
+ * skipped.
+ * @return the number of runs that are slower than baseline*(1 - tolerance), -1 if the file can't be read
+ */
+int compareBaseline(const char *fileName, double tolerance) {
+    FILE *file = fopen(fileName, "r");
+    if (file == NULL) {
+        printf("Could not open baseline %s\n", fileName);
+        return -1;
+    }
+    char line[512];
+    int regressions = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char workload[32], engine[16], dcache[32];
+        long n;
+        double mips;
+        if (sscanf(line, "%31[^,],%ld,%15[^,],%31[^,],%*[^,],%*[^,],%*[^,],%*[^,],%lf", workload, &n, engine, dcache, &mips) != 5) {
+            continue; /* the header */
+        }
+        int r;
+        for (r = 0; r < NumResults; r++) {
+            struct BenchResult *b = &Results[r];
+            if (b->n != n || strcmp(b->workload, workload) != 0 || strcmp(b->engine, engine) != 0
+                || strcmp(b->dcache, dcache) != 0) continue;
+            if (b->mips < mips*(1 - tolerance)) {
+                fprintf(stderr, "Regression: %s n=%ld %s dcache %s: %.2f MIPS, baseline %.2f MIPS (%+.1f%%)\n",
+                        workload, n, engine, dcache, b->mips, mips, 100*(b->mips/mips - 1));
+                regressions++;
+            }
+        }
+    }
+    fclose(file);
+    return regressions;
+}
+
+void usage() {
+    printf("Usage: cpusim_bench [options]\n"
+           "  --sim <path>        simulator binary (default ../cpusim_cachesim)\n"
+           "  --kernels <dir>     directory of the <workload>.asm.bin kernels (default .)\n"
+           "  --workloads <list>  comma separated workloads (default stream,stride,chase,branch,conv3)\n"
+           "  --sizes <list>      comma separated N (default 256,65536,1048576,16777216)\n"
+           "  --engines <list>    comma separated engines: detailed, fast, jit (default detailed,fast)\n"
+           "  --dcaches <list>    comma separated --dcache geometries, default is the simulator's (default default,256:4:64)\n"
+           "  --repeat <n>        runs of each point, the fastest is reported (default 1)\n"
+           "  --format <csv|json> report format (default csv)\n"
+           "  --output <file>     write the report to file instead of stdout\n"
+           "  --baseline <file>   CSV report of an earlier run, fail if any run is slower\n"
+           "  --tolerance <f>     MIPS drop allowed against the baseline (default 0.10)\n");
+}
+
+int main(int argc, char *argv[]) {
+    char workloads[256] = "stream,stride,chase,branch,conv3";
+    char sizes[256] = "256,65536,1048576,16777216";
+    char engines[256] = "detailed,fast";
+    char dcaches[256] = "default,256:4:64";
+    const char *format = "csv", *outputName = NULL, *baseline = NULL;
+    double tolerance = 0.10;
+    int arg;
+    for (arg = 1; arg < argc; arg++) {
+        if (strncmp(argv[arg], "--", 2) != 0 || arg + 1 == argc) {
+            usage();
+            return 1;
+        }
+        const char *key = argv[arg] + 2;
+        const char *value = argv[++arg];
+        int ok = strlen(value) < sizeof(workloads);
+        if (strcmp(key, "sim") == 0 && ok) strcpy(SimPath, value);
+        else if (strcmp(key, "kernels") == 0 && ok) strcpy(KernelDir, value);
+        else if (strcmp(key, "workloads") == 0 && ok) strcpy(workloads, value);
+        else if (strcmp(key, "sizes") == 0 && ok) strcpy(sizes, value);
+        else if (strcmp(key, "engines") == 0 && ok) strcpy(engines, value);
+        else if (strcmp(key, "dcaches") == 0 && ok) strcpy(dcaches, value);
+        else if (strcmp(key, "repeat") == 0) ok = (Repeat = atoi(value)) > 0;
+        else if (strcmp(key, "format") == 0) ok = strcmp(format = value, "csv") == 0 || strcmp(value, "json") == 0;
+        else if (strcmp(key, "output") == 0) outputName = value;
+        else if (strcmp(key, "baseline") == 0) baseline = value;
+        else if (strcmp(key, "tolerance") == 0) ok = (tolerance = atof(value)) >= 0;
+        else ok = 0;
+        if (!ok) {
+            printf("Invalid option --%s %s\n", key, value);
+            usage();
+            return 1;
+        }
+    }
+    /* the paths may be relative to the current directory, the child runs somewhere else */
+    char resolved[PATH_MAX];
+    if (realpath(SimPath, resolved) == NULL) {
+        printf("Could not find the simulator %s\n", SimPath);
+        return 1;
+    }
+    strcpy(SimPath, resolved);
+    if (realpath(KernelDir, resolved) == NULL) {
+        printf("Could not find the kernel directory %s\n", KernelDir);
+        return 1;
+    }
+    strcpy(KernelDir, resolved);
+    NumWorkloads = splitList(workloads, WorkloadList);
+    NumSizes = splitList(sizes, SizeList);
+    NumEngines = splitList(engines, EngineList);
+    NumCaches = splitList(dcaches, CacheList);
+    if (!NumWorkloads || !NumSizes || !NumEngines || !NumCaches) {
+        printf("Empty or too long list, at most %d items each\n", MAX_ITEMS);
+        return 1;
+    }
+
+    char scratchDir[] = "/tmp/cpusim_bench.XXXXXX";
+    if (mkdtemp(scratchDir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    int w, s, e, c, failed = 0;
+    for (w = 0; w < NumWorkloads; w++)
+    for (s = 0; s < NumSizes; s++)
+    for (e = 0; e < NumEngines; e++)
+    for (c = 0; c < NumCaches; c++) {
+        /* only the detailed engine has a cache model, one run is enough for the fast and jit engines */
+        if (strcmp(EngineList[e], "detailed") != 0 && c > 0) continue;
+        if (NumResults == MAX_RESULTS) break;
+        long n = atol(SizeList[s]);
+        struct BenchResult best, run;
+        int k, ok = 1;
+        for (k = 0; k < Repeat && ok; k++) {
+            ok = runOnce(WorkloadList[w], n, EngineList[e], CacheList[c], scratchDir, &run);
+            if (ok && (k == 0 || run.mips > best.mips)) best = run;
+        }
+        if (!ok) {
+            failed = 1;
+            continue;
+        }
+        if (!best.verified) failed = 1;
+        Results[NumResults++] = best;
+        fprintf(stderr, "%-8s n=%-9ld %-8s dcache %-10s %12lld instr %9.2f MIPS %8ld KB%s\n", best.workload, best.n,
+                best.engine, best.dcache, best.instructions, best.mips, best.maxRSSKB, best.verified ? "" : " FAILED");
+    }
+    char traceFile[sizeof(scratchDir) + 32];
+    snprintf(traceFile, sizeof(traceFile), "%s/cpusim_trace.txt", scratchDir);
+    remove(traceFile);
+    rmdir(scratchDir);
+
+    FILE *out = outputName ? fopen(outputName, "w") : stdout;
+    if (out == NULL) {
+        printf("Could not open %s\n", outputName);
+        return 1;
+    }
+    if (strcmp(format, "json") == 0) writeJSON(out); else writeCSV(out);
+    if (out != stdout) fclose(out);
+
+    if (baseline != NULL) {
+        int regressions = compareBaseline(baseline, tolerance);
+        if (regressions != 0) failed = 1;
+    }
+    return failed;
+}
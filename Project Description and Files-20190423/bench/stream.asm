@@ -0,0 +1,16 @@
+# Benchmark kernel: unit-stride stream (workload stream)
+# for (i=0; i != N; i++)
+#    A[i] = 3*B[i];
+# The address of A and B are in $s1 and $s2, N is read from $s4: run with --n N --reg 4=N.
+# $s3 holds the byte offset i*4.
+
+ADDI, $s5, $s0, 3            # instruction #0, the constant 3
+SLL,  $s12, $s4, 2           # 1, N*4, the loop ends when $s3 gets there
+ADDI, $s3, $s0, 0            # 2, i = 0
+# loop label:   which is instruction 3
+LWR,  $s6, $s2, $s3          # 3, B[i]
+MUL,  $s7, $s6, $s5          # 4, 3*B[i]
+SWR,  $s7, $s1, $s3          # 5, A[i] stored the result
+ADDI, $s3, $s3, 4            # 6, i++
+BNE,  $s3, $s12, -5          # 7, back to the loop (instruction 3) while i != N
+J, 999999                    # 8, terminate the program
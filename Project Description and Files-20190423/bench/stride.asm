@@ -0,0 +1,24 @@
+# Benchmark kernel: 64-byte strided walk (workload stride)
+# for (c=0; c != 16; c++)
+#    for (i=c; i < N; i += 16)
+#       A[i] = B[i] + 1;
+# B is walked as rows of 16 words, column by column, so consecutive accesses are 64 bytes apart.
+# The address of A and B are in $s1 and $s2, N is read from $s4: run with --n N --reg 4=N.
+
+SLL,  $s12, $s4, 2           # instruction #0, N*4
+ADDI, $s13, $s0, 64          # 1, the row size in bytes, also where the column offset ends
+ADDI, $s5, $s0, 0            # 2, c*4 = 0
+# column label:   which is instruction 3
+ADD,  $s3, $s5, $s0          # 3, i*4 = c*4
+SLT,  $s7, $s3, $s12         # 4, i < N, tested before the first row so that N < 16 does not overrun
+BEQ,  $s7, $s0, 6            # 5, column is empty: on to the next one (instruction 12)
+# row label:   which is instruction 6
+LWR,  $s6, $s2, $s3          # 6, B[i]
+ADDI, $s6, $s6, 1            # 7, B[i] + 1
+SWR,  $s6, $s1, $s3          # 8, A[i] stored the result
+ADD,  $s3, $s3, $s13         # 9, i += 16
+SLT,  $s7, $s3, $s12         # 10, i < N
+BNE,  $s7, $s0, -6           # 11, back to the row loop (instruction 6) while i < N
+ADDI, $s5, $s5, 4            # 12, c++
+BNE,  $s5, $s13, -11         # 13, back to the column loop (instruction 3) while c != 16
+J, 999999                    # 14, terminate the program
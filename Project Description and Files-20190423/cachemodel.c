@@ -0,0 +1,1311 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "cachemodel.h"
+
+/* the cache model shared by cpusim_cachesim and cachesim, the structures are described in cachemodel.h */
+
+struct Cache InstructionCache = { .name = "Instruction", .numSets = 4, .numWays = 1, .blockBytes = 8,
+    .prefetcher = &IPrefetch, .missClass = &IMissClass };
+struct Cache DataCache = { .name = "Data", .numSets = 64, .numWays = 1, .blockBytes = 16,
+    .prefetcher = &DPrefetch, .missClass = &DMissClass };
+struct Prefetcher IPrefetch = { .cacheName = "Instruction", .kind = PREFETCH_NONE, .degree = 1, .latency = 0,
+    .cache = &InstructionCache, .numStreams = 4, .streamDepth = 4 };
+struct Prefetcher DPrefetch = { .cacheName = "Data", .kind = PREFETCH_NONE, .degree = 1, .latency = 0,
+    .cache = &DataCache, .numStreams = 4, .streamDepth = 4 };
+struct MissClassifier IMissClass, DMissClass;
+struct VictimCache IVictim, DVictim;
+struct CoherenceBus Bus;
+struct MSHRFile DMSHR = { .numEntries = 8, .latency = 100 };
+struct DRAM Dram = { .channels = 1, .banks = 8, .rowBytes = 2048, .tRCD = 14, .tCL = 14, .tRP = 14, .tBurst = 4,
+    .queueDepth = 32 };
+struct MMU DMMU = { .l1 = { .numEntries = 64, .numWays = 4 }, .l2 = { .numEntries = 1024, .numWays = 8 }, .l2Latency = 7,
+    .walkLatency = 30, .pageTable = &ProcessPageTable };
+struct PageTable ProcessPageTable;
+
+/**
+ * Allocate the arrays of a cache whose geometry has been set, behind memory of memoryBytes bytes
+ */
+void initCache(struct Cache *c, char *memory, unsigned long long memoryBytes) {
+    c->blockShift = __builtin_ctz(c->blockBytes);
+    c->wayStride = (c->numWays + CACHE_WAY_ALIGN - 1) / CACHE_WAY_ALIGN * CACHE_WAY_ALIGN;
+    c->memory = memory;
+    c->memoryBlocks = (unsigned int)(memoryBytes >> c->blockShift);
+    c->tags = (unsigned int*) malloc((size_t)c->numSets*c->wayStride*sizeof(unsigned int));
+    memset(c->tags, 0xFF, (size_t)c->numSets*c->wayStride*sizeof(unsigned int));
+    c->validBits = (unsigned int*) calloc(c->numSets, sizeof(unsigned int));
+    c->prefetchedBits = (unsigned int*) calloc(c->numSets, sizeof(unsigned int));
+    c->lastUse = (unsigned long long*) calloc((size_t)c->numSets*c->numWays, sizeof(unsigned long long));
+    c->arena = (unsigned int*) calloc((size_t)c->numSets*c->numWays*(c->blockBytes/4), sizeof(unsigned int));
+}
+
+/**
+ * Parse a cache geometry given as <sets>:<ways>:<blockBytes>, all powers of two
+ * @return 1 on success
+ */
+int setCacheGeometry(struct Cache *c, const char *value) {
+    int sets, ways, blockBytes;
+    char extra;
+    if (sscanf(value, "%d:%d:%d%c", &sets, &ways, &blockBytes, &extra) != 3) return 0;
+    if (sets <= 0 || (sets & (sets - 1)) || ways <= 0 || ways > MAX_CACHE_WAYS || (ways & (ways - 1)) ||
+        blockBytes < 4 || blockBytes > MAX_BLOCK_WORDS*4 || (blockBytes & (blockBytes - 1))) return 0;
+    c->numSets = sets;
+    c->numWays = ways;
+    c->blockBytes = blockBytes;
+    return 1;
+}
+
+/**
+ * Find the way of the set holding block.
+ * @return the way, or -1 on a miss
+ */
+static inline int cacheLookup(struct Cache *c, unsigned int block) {
+    unsigned int set = CacheSetOf(c, block);
+    const unsigned int *tags = &c->tags[(size_t)set*c->wayStride];
+    unsigned int valid = c->validBits[set];
+    int w;
+    if (c->numWays == 1) return (valid & 1) && tags[0] == block ? 0 : -1;
+#if defined(__AVX2__)
+    __m256i key = _mm256_set1_epi32((int)block);
+    for (w = 0; w < c->numWays; w += 8) {
+        __m256i row = _mm256_loadu_si256((const __m256i*)&tags[w]);
+        unsigned int match = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(row, key)));
+        match &= valid >> w;
+        if (match) return w + __builtin_ctz(match);
+    }
+#elif defined(__SSE2__)
+    __m128i key = _mm_set1_epi32((int)block);
+    for (w = 0; w < c->numWays; w += 4) {
+        __m128i row = _mm_loadu_si128((const __m128i*)&tags[w]);
+        unsigned int match = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(row, key)));
+        match &= valid >> w;
+        if (match) return w + __builtin_ctz(match);
+    }
+#else
+    for (w = 0; w < c->numWays; w++) {
+        if (((valid >> w) & 1) && tags[w] == block) return w;
+    }
+#endif
+    return -1;
+}
+
+/**
+ * Mark a way as most recently used and as used by a demand access
+ * @return 1 if this is the first demand use of a prefetched block
+ */
+static inline int cacheTouch(struct Cache *c, unsigned int set, int way) {
+    unsigned int bit = 1u << way;
+    int firstUse = (c->prefetchedBits[set] & bit) != 0;
+    c->prefetchedBits[set] &= ~bit;
+    c->lastUse[(size_t)set*c->numWays + way] = ++c->useClock;
+    return firstUse;
+}
+
+void victimInsert(struct VictimCache *v, unsigned int block, const unsigned int *data);
+static void coherenceFill(struct Cache *c, unsigned int set, int way, unsigned int block);
+
+/**
+ * Put block in its set, replacing an invalid way or else the least recently used one. The evicted block
+ * goes to the victim cache if there is one.
+ * @param data the payload, or NULL to read the block from the memory behind the cache
+ * @param prefetched 1 if the block is brought in by a prefetch rather than a demand access
+ * @param evictedUnused set to 1 if the evicted block was an unused prefetch
+ * @return the way the block was put in
+ */
+int cacheFill(struct Cache *c, unsigned int block, const unsigned int *data, int prefetched, int *evictedUnused) {
+    unsigned int set = CacheSetOf(c, block);
+    unsigned int invalid = ~c->validBits[set] & (c->numWays == 32 ? 0xFFFFFFFFu : (1u << c->numWays) - 1);
+    int way = 0, w;
+    *evictedUnused = 0;
+    if (invalid) {
+        way = __builtin_ctz(invalid);
+    } else {
+        const unsigned long long *stamps = &c->lastUse[(size_t)set*c->numWays];
+        for (w = 1; w < c->numWays; w++) {
+            if (stamps[w] < stamps[way]) way = w;
+        }
+        *evictedUnused = (c->prefetchedBits[set] >> way) & 1;
+        if (c->victim != NULL) victimInsert(c->victim, c->tags[(size_t)set*c->wayStride + way], CacheBlockData(c, set, way));
+        if (c->bus != NULL && c->state[(size_t)set*c->numWays + way] == MESI_MODIFIED) c->writebacks++;
+    }
+    unsigned int bit = 1u << way;
+    memcpy(CacheBlockData(c, set, way), data ? (const void*)data : (const void*)&c->memory[(size_t)block << c->blockShift],
+           c->blockBytes);
+    c->tags[(size_t)set*c->wayStride + way] = block;
+    c->validBits[set] |= bit;
+    if (prefetched) c->prefetchedBits[set] |= bit; else c->prefetchedBits[set] &= ~bit;
+    c->lastUse[(size_t)set*c->numWays + way] = ++c->useClock;
+    if (c->bus != NULL) coherenceFill(c, set, way, block);
+    return way;
+}
+
+/**
+ * Number of blocks still marked as unused prefetches
+ */
+unsigned long long cacheUnusedPrefetches(struct Cache *c) {
+    unsigned long long count = 0;
+    int set;
+    for (set = 0; set < c->numSets; set++) count += __builtin_popcount(c->prefetchedBits[set] & c->validBits[set]);
+    return count;
+}
+
+const char *prefetchKindName(int kind) {
+    switch (kind) {
+        case PREFETCH_NEXT_LINE: return "next-line";
+        case PREFETCH_STRIDE: return "stride";
+        case PREFETCH_STREAM: return "stream";
+    }
+    return "none";
+}
+
+/**
+ * Queue a prefetch for a block unless it is already cached, on its way or outside memory
+ */
+void issuePrefetch(struct Prefetcher *p, unsigned int block) {
+    int i, evictedUnused;
+    if (block >= p->cache->memoryBlocks || cacheLookup(p->cache, block) >= 0) return;
+    for (i = 0; i < p->numInFlight; i++) {
+        if (p->inFlight[i].block == block) return;
+    }
+    p->issued++;
+    if (p->latency == 0) {
+        cacheFill(p->cache, block, NULL, 1, &evictedUnused);
+        p->useless += evictedUnused;
+        return;
+    }
+    if (p->numInFlight == PREFETCH_QUEUE_SIZE) {  /* queue full, the oldest request is dropped */
+        p->useless++;
+        memmove(&p->inFlight[0], &p->inFlight[1], (PREFETCH_QUEUE_SIZE-1)*sizeof(struct PrefetchRequest));
+        p->numInFlight--;
+    }
+    p->inFlight[p->numInFlight].block = block;
+    p->inFlight[p->numInFlight].readyAt = p->clock + p->latency;
+    p->numInFlight++;
+}
+
+/**
+ * Advance the prefetcher clock by one cache access and install the prefetches that have arrived
+ */
+void prefetchTick(struct Prefetcher *p) {
+    p->clock++;
+    int i, kept = 0, evictedUnused;
+    for (i = 0; i < p->numInFlight; i++) {
+        if (p->inFlight[i].readyAt <= p->clock) {
+            if (cacheLookup(p->cache, p->inFlight[i].block) < 0) {
+                cacheFill(p->cache, p->inFlight[i].block, NULL, 1, &evictedUnused);
+                p->useless += evictedUnused;
+            }
+        } else {
+            p->inFlight[kept++] = p->inFlight[i];
+        }
+    }
+    p->numInFlight = kept;
+}
+
+/**
+ * Fill stream buffer s with the blocks following block
+ */
+void allocateStream(struct Prefetcher *p, struct StreamBuffer *s, unsigned int block) {
+    p->useless += s->count;
+    s->count = 0;
+    s->lastUse = p->clock;
+    while (s->count < p->streamDepth && block + 1 + s->count < p->cache->memoryBlocks) {
+        s->entry[s->count].block = block + 1 + s->count;
+        s->entry[s->count].readyAt = p->clock + p->latency;
+        s->count++;
+        p->issued++;
+    }
+}
+
+/**
+ * Called on a demand miss, before the block is fetched from memory.
+ * @return 1 if the block was supplied by a prefetch in time (the access counts as a hit), 0 otherwise
+ */
+int prefetchOnMiss(struct Prefetcher *p, unsigned int block) {
+    int i, j;
+    for (i = 0; i < p->numInFlight; i++) {
+        if (p->inFlight[i].block == block) {  /* the prefetch was issued but is not here yet */
+            p->late++;
+            p->numInFlight--;
+            memmove(&p->inFlight[i], &p->inFlight[i+1], (p->numInFlight - i)*sizeof(struct PrefetchRequest));
+            break;
+        }
+    }
+    if (p->kind != PREFETCH_STREAM) return 0;
+
+    for (i = 0; i < p->numStreams; i++) {
+        struct StreamBuffer *s = &p->stream[i];
+        for (j = 0; j < s->count; j++) {
+            if (s->entry[j].block != block) continue;
+            int inTime = s->entry[j].readyAt <= p->clock;
+            if (inTime) p->useful++; else p->late++;
+            /* entries before the hit are skipped over and wasted, the buffer is topped up at the tail */
+            p->useless += j;
+            unsigned int next = s->entry[s->count-1].block + 1;
+            s->count -= j + 1;
+            memmove(&s->entry[0], &s->entry[j+1], s->count*sizeof(struct PrefetchRequest));
+            while (s->count < p->streamDepth && next < p->cache->memoryBlocks) {
+                s->entry[s->count].block = next++;
+                s->entry[s->count].readyAt = p->clock + p->latency;
+                s->count++;
+                p->issued++;
+            }
+            s->lastUse = p->clock;
+            return inTime;
+        }
+    }
+    struct StreamBuffer *lru = &p->stream[0];
+    for (i = 1; i < p->numStreams; i++) {
+        if (p->stream[i].lastUse < lru->lastUse) lru = &p->stream[i];
+    }
+    allocateStream(p, lru, block);
+    return 0;
+}
+
+/**
+ * Train the prefetcher with a demand access and issue new prefetches.
+ * @param pc the PC of the load/store (for the stride table)
+ * @param miss 1 if the access missed in the cache
+ * @param firstUse 1 if the access hit a prefetched block for the first time
+ */
+void prefetchTrain(struct Prefetcher *p, unsigned int pc, unsigned int addr, int miss, int firstUse) {
+    unsigned int block = addr >> p->cache->blockShift;
+    int k;
+    if (firstUse) p->useful++;
+    switch (p->kind) {
+        case PREFETCH_NEXT_LINE:
+            if (miss || firstUse) {
+                for (k = 1; k <= p->degree; k++) issuePrefetch(p, block + k);
+            }
+            break;
+        case PREFETCH_STRIDE: {
+            struct StrideEntry *e = &p->strideTable[(pc >> 2) % STRIDE_TABLE_SIZE];
+            if (e->pc != pc) {
+                e->pc = pc;
+                e->lastAddr = addr;
+                e->stride = 0;
+                e->confidence = 0;
+                break;
+            }
+            int stride = (int)(addr - e->lastAddr);
+            if (stride == e->stride && stride != 0) {
+                if (e->confidence < 3) e->confidence++;
+            } else {
+                if (e->confidence > 0) e->confidence--;
+                if (e->confidence == 0) e->stride = stride;
+            }
+            e->lastAddr = addr;
+            if (e->confidence >= 2) {
+                for (k = 1; k <= p->degree; k++) {
+                    unsigned int target = (addr + (unsigned int)(e->stride*k)) >> p->cache->blockShift;
+                    if (target != block) issuePrefetch(p, target);
+                }
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * Blocks still sitting unused in the cache or a stream buffer at the end of the run are useless prefetches
+ */
+void prefetchFinish(struct Prefetcher *p, unsigned long long unusedInCache) {
+    int i;
+    p->useless += unusedInCache + p->numInFlight;
+    for (i = 0; i < p->numStreams; i++) p->useless += p->stream[i].count;
+}
+
+void printPrefetchSummary(FILE *file, struct Prefetcher *p) {
+    if (p->kind == PREFETCH_NONE) return;
+    fprintf(file, "\t %s Prefetcher (%s): issued %llu, useful %llu, late %llu, useless %llu, Accuracy: %.2f\n",
+            p->cacheName, prefetchKindName(p->kind), p->issued, p->useful, p->late, p->useless,
+            p->issued ? ((float)p->useful)/((float)p->issued) : 0.0f);
+}
+
+int setPrefetchKind(struct Prefetcher *p, const char *value) {
+    if (strcmp(value, "none") == 0) p->kind = PREFETCH_NONE;
+    else if (strcmp(value, "next-line") == 0) p->kind = PREFETCH_NEXT_LINE;
+    else if (strcmp(value, "stride") == 0 && p == &DPrefetch) p->kind = PREFETCH_STRIDE;
+    else if (strcmp(value, "stream") == 0) p->kind = PREFETCH_STREAM;
+    else return 0;
+    return 1;
+}
+
+/**
+ * Insert a block number into the set.
+ * @return 1 if the block was not in the set before
+ */
+int blockSetInsert(struct BlockSet *set, unsigned int block) {
+    unsigned long long h;
+    if (set->slot == NULL || (set->used + 1)*2 > set->mask + 1) {
+        struct BlockSet bigger;
+        unsigned long long i;
+        bigger.mask = set->slot ? set->mask*2 + 1 : 1023;
+        bigger.used = 0;
+        bigger.slot = (unsigned int*) calloc(bigger.mask + 1, sizeof(unsigned int));
+        for (i = 0; set->slot && i <= set->mask; i++) {
+            if (set->slot[i]) blockSetInsert(&bigger, set->slot[i] - 1);
+        }
+        free(set->slot);
+        *set = bigger;
+    }
+    for (h = (block * 0x9E3779B97F4A7C15ULL) >> 17;; h++) {
+        unsigned int *slot = &set->slot[h & set->mask];
+        if (*slot == block + 1) return 0;
+        if (*slot == 0) {
+            *slot = block + 1;
+            set->used++;
+            return 1;
+        }
+    }
+}
+
+void initMissClassifier(struct MissClassifier *c, struct Cache *cache) {
+    c->numBlocks = cache->numSets*cache->numWays;
+    c->lru = (unsigned int*) malloc(c->numBlocks*sizeof(unsigned int));
+}
+
+/**
+ * Called on every demand access of a cache.
+ * @param miss 1 if the real cache missed
+ */
+void classifyAccess(struct MissClassifier *c, unsigned int block, int miss) {
+    int firstTouch = blockSetInsert(&c->seen, block);
+    int i;
+    for (i = 0; i < c->count && c->lru[i] != block; i++);
+    int shadowHit = i < c->count;
+    if (!shadowHit) {
+        if (c->count < c->numBlocks) c->count++;
+        i = c->count - 1;            /* the least recently used block falls off the end */
+    }
+    memmove(&c->lru[1], &c->lru[0], i*sizeof(unsigned int));
+    c->lru[0] = block;
+
+    if (!miss) return;
+    if (firstTouch) c->compulsory++;
+    else if (!shadowHit) c->capacity++;
+    else c->conflict++;
+}
+
+void printMissClassSummary(FILE *file, const char *cacheName, struct MissClassifier *c) {
+    if (!c->enabled) return;
+    unsigned long long misses = c->compulsory + c->capacity + c->conflict;
+    fprintf(file, "\t %s Cache Misses: %llu, Compulsory: %llu (%.2f), Capacity: %llu (%.2f), Conflict: %llu (%.2f)\n",
+            cacheName, misses, c->compulsory, misses ? ((float)c->compulsory)/misses : 0.0f,
+            c->capacity, misses ? ((float)c->capacity)/misses : 0.0f, c->conflict, misses ? ((float)c->conflict)/misses : 0.0f);
+}
+
+void victimInsert(struct VictimCache *v, unsigned int block, const unsigned int *data) {
+    int i;
+    struct VictimEntry *lru = &v->entry[0];
+    for (i = 0; i < v->numEntries; i++) {
+        if (!v->entry[i].valid) {
+            lru = &v->entry[i];
+            break;
+        }
+        if (v->entry[i].lastUse < lru->lastUse) lru = &v->entry[i];
+    }
+    lru->valid = 1;
+    lru->block = block;
+    lru->lastUse = ++v->clock;
+    memcpy(lru->data, data, v->blockWords*sizeof(unsigned int));
+}
+
+/**
+ * Look up an L1 miss. On a hit the block is copied to data and leaves the victim cache (it moves to the L1).
+ * @return 1 on a hit
+ */
+int victimLookup(struct VictimCache *v, unsigned int block, unsigned int *data) {
+    int i;
+    v->probes++;
+    for (i = 0; i < v->numEntries; i++) {
+        if (v->entry[i].valid && v->entry[i].block == block) {
+            v->hits++;
+            v->entry[i].valid = 0;
+            memcpy(data, v->entry[i].data, v->blockWords*sizeof(unsigned int));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Snoop the victim cache for a block
+ * @param drop remove the block if it is there
+ * @return 1 if the victim cache holds the block
+ */
+int victimProbe(struct VictimCache *v, unsigned int block, int drop) {
+    int i;
+    for (i = 0; i < v->numEntries; i++) {
+        if (v->entry[i].valid && v->entry[i].block == block) {
+            if (drop) v->entry[i].valid = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void printVictimSummary(FILE *file, const char *cacheName, struct VictimCache *v) {
+    if (!v->numEntries) return;
+    fprintf(file, "\t %s Victim Cache (%d entries): L1 Misses Looked Up: %llu, VictimCacheHit: %llu, Hit Ratio: %.2f\n",
+            cacheName, v->numEntries, v->probes, v->hits, v->probes ? ((float)v->hits)/v->probes : 0.0f);
+}
+
+/**
+ * The timing of a data cache access made at cycle *now.
+ * @param miss 1 if the block had to be fetched from memory
+ * @param now  advanced if the access has to wait: for a free MSHR, or for the block itself in a blocking cache
+ * @return the cycle the data is there
+ */
+unsigned long long mshrAccess(struct MSHRFile *m, unsigned int block, int miss, unsigned long long *now) {
+    int i, kept = 0;
+    for (i = 0; i < m->count; i++) {
+        if (m->entry[i].readyAt > *now) m->entry[kept++] = m->entry[i];
+    }
+    m->count = kept;
+    for (i = 0; i < m->count; i++) {
+        if (m->entry[i].block == block) {
+            m->secondary++;
+            return m->entry[i].readyAt;
+        }
+    }
+    if (!miss) {
+        m->hitsUnderMiss += m->count > 0;
+        return *now;
+    }
+    if (m->numEntries > 0 && m->count == m->numEntries) {  /* wait for the first MSHR to complete */
+        unsigned long long first = m->entry[0].readyAt;
+        for (i = 1; i < m->count; i++) {
+            if (m->entry[i].readyAt < first) first = m->entry[i].readyAt;
+        }
+        m->fullStalls += first - *now;
+        *now = first;
+        for (i = 0, kept = 0; i < m->count; i++) {
+            if (m->entry[i].readyAt > *now) m->entry[kept++] = m->entry[i];
+        }
+        m->count = kept;
+    }
+    unsigned long long readyAt = m->dram != NULL ? dramRead(m->dram, block, *now) : *now + m->latency;
+    m->primary++;
+    m->missesUnderMiss += m->count > 0;
+    m->missCycles += readyAt - *now;
+    m->busyCycles += readyAt - (m->busyUntil > *now ? m->busyUntil : *now);
+    m->busyUntil = readyAt;
+    if (m->numEntries == 0) {
+        *now = readyAt;
+    } else {
+        m->entry[m->count].block = block;
+        m->entry[m->count].readyAt = readyAt;
+        m->count++;
+    }
+    return readyAt;
+}
+
+void printMSHRSummary(FILE *file, const char *cacheName, struct MSHRFile *m) {
+    char latency[32];
+    if (m->dram != NULL) snprintf(latency, sizeof(latency), "DRAM");
+    else snprintf(latency, sizeof(latency), "%d-cycle", m->latency);
+    fprintf(file, "\t %s Cache MSHRs (%d, %s misses): Primary Misses: %llu, Secondary Misses: %llu, Hits Under Miss: %llu, Misses Under Miss: %llu, MSHRs Full: %llu cycles, MLP: %.2f\n",
+            cacheName, m->numEntries, latency, m->primary, m->secondary, m->hitsUnderMiss, m->missesUnderMiss,
+            m->fullStalls, m->busyCycles ? ((double)m->missCycles)/m->busyCycles : 0.0);
+}
+
+/**
+ * Set one of the DRAM options of cpusim_cachesim (--dram, --dram-timing, ...).
+ * @return 1 on success, 0 if the value is invalid, -1 if key is not a DRAM option
+ */
+int setDRAMOption(const char *key, const char *value) {
+    char *end, extra;
+    if (strcmp(key, "dram") == 0) {
+        int channels, banks, rowBytes;
+        if (sscanf(value, "%d:%d:%d%c", &channels, &banks, &rowBytes, &extra) != 3) return 0;
+        if (channels <= 0 || channels > MAX_DRAM_CHANNELS || banks <= 0 || banks > MAX_DRAM_BANKS ||
+            rowBytes < 4 || (rowBytes & (rowBytes - 1))) return 0;
+        Dram.channels = channels;
+        Dram.banks = banks;
+        Dram.rowBytes = rowBytes;
+        Dram.enabled = 1;
+        return 1;
+    } else if (strcmp(key, "dram-timing") == 0) {
+        int tRCD, tCL, tRP, tBurst;
+        if (sscanf(value, "%d:%d:%d:%d%c", &tRCD, &tCL, &tRP, &tBurst, &extra) != 4) return 0;
+        if (tRCD < 0 || tCL < 0 || tRP < 0 || tBurst <= 0) return 0;
+        Dram.tRCD = tRCD;
+        Dram.tCL = tCL;
+        Dram.tRP = tRP;
+        Dram.tBurst = tBurst;
+        return 1;
+    } else if (strcmp(key, "dram-policy") == 0) {
+        if (strcmp(value, "open") == 0) Dram.closedPage = 0;
+        else if (strcmp(value, "closed") == 0) Dram.closedPage = 1;
+        else return 0;
+        return 1;
+    } else if (strcmp(key, "dram-queue") == 0) {
+        Dram.queueDepth = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && Dram.queueDepth > 0 && Dram.queueDepth <= MAX_DRAM_QUEUE;
+    }
+    return -1;
+}
+
+void printDRAMOptions() {
+    printf("  --dram <c>:<b>:<r>  time the data cache misses with a DRAM of c channels of b banks with r-byte rows\n"
+           "                      (needs --timing 1, default off)\n"
+           "  --dram-timing <tRCD>:<tCL>:<tRP>:<tBurst> DRAM timings in cycles (default 14:14:14:4)\n"
+           "  --dram-policy <open|closed> leave the row open after an access or precharge at once (default open)\n"
+           "  --dram-queue <n>    requests queued per channel for the FR-FCFS scheduler (default 32, max 64)\n");
+}
+
+/**
+ * Get the DRAM ready for a cache with blocks of blockBytes, one block per request
+ * @return 0 if a row does not hold a whole block
+ */
+int initDRAM(struct DRAM *d, int blockBytes) {
+    int c, b;
+    if (d->rowBytes < blockBytes) return 0;
+    d->blockBytes = blockBytes;
+    for (c = 0; c < d->channels; c++) {
+        for (b = 0; b < d->banks; b++) d->channel[c].bank[b].openRow = DRAM_NO_ROW;
+    }
+    return 1;
+}
+
+/**
+ * Serve the request the FR-FCFS scheduler of the channel picks next, the channel must have one queued
+ * @param id     set to the request served
+ * @param picked set to the cycle the scheduler picked it, its queue slot is free from then on
+ * @return the cycle its data is done on the bus
+ */
+static unsigned long long dramServeNext(struct DRAM *d, struct DRAMChannel *ch, unsigned long long *id,
+                                        unsigned long long *picked) {
+    unsigned long long at = ch->queue[0].arrival;
+    int i, pick = -1;
+    for (i = 1; i < ch->count; i++) {
+        if (ch->queue[i].arrival < at) at = ch->queue[i].arrival;
+    }
+    if (at < ch->clock) at = ch->clock;
+    for (i = 0; i < ch->count && pick < 0; i++) {   /* first ready: the oldest hitting an open row */
+        if (ch->queue[i].arrival <= at && ch->bank[ch->queue[i].bank].openRow == ch->queue[i].row) pick = i;
+    }
+    for (i = 0; i < ch->count && pick < 0; i++) {   /* then first come */
+        if (ch->queue[i].arrival <= at) pick = i;
+    }
+    struct DRAMRequest r = ch->queue[pick];
+    memmove(&ch->queue[pick], &ch->queue[pick + 1], (size_t)(ch->count - pick - 1)*sizeof(struct DRAMRequest));
+    ch->count--;
+
+    struct DRAMBank *b = &ch->bank[r.bank];
+    unsigned long long start = b->readyAt > at ? b->readyAt : at, column;
+    if (b->openRow == r.row) {
+        d->rowHits++;
+        column = start;
+    } else if (b->openRow == DRAM_NO_ROW) {
+        d->rowEmpty++;
+        column = start + d->tRCD;
+    } else {
+        d->rowConflicts++;
+        column = start + d->tRP + d->tRCD;
+    }
+    unsigned long long data = column + d->tCL;
+    if (data < ch->busFree) data = ch->busFree;
+    unsigned long long done = data + d->tBurst;
+    ch->busFree = done;
+    ch->busyCycles += d->tBurst;
+    if (d->closedPage) {
+        b->openRow = DRAM_NO_ROW;
+        b->readyAt = done + d->tRP;
+    } else {
+        b->openRow = r.row;
+        b->readyAt = column + d->tBurst;
+    }
+    ch->clock = at + 1;                             /* one command per cycle */
+    if (done > d->lastDone) d->lastDone = done;
+    if (r.isWrite) {
+        d->writes++;
+    } else {
+        d->reads++;
+        d->readCycles += done - r.arrival;
+    }
+    *id = r.id;
+    *picked = at;
+    return done;
+}
+
+/* queue a request for the block once its channel has room, *now is advanced to when it had */
+static struct DRAMChannel *dramEnqueue(struct DRAM *d, unsigned int block, int isWrite, unsigned long long *now,
+                                       unsigned long long *id) {
+    unsigned long long row = (unsigned long long)block*d->blockBytes/d->rowBytes, served, picked;
+    struct DRAMChannel *ch = &d->channel[row % d->channels];
+    if (ch->count == d->queueDepth) {
+        dramServeNext(d, ch, &served, &picked);
+        if (picked > *now) *now = picked;
+    }
+    struct DRAMRequest *r = &ch->queue[ch->count++];
+    row /= d->channels;
+    r->bank = row % d->banks;
+    r->row = (unsigned int)(row / d->banks);
+    r->arrival = *now;
+    r->isWrite = isWrite;
+    r->id = *id = d->nextId++;
+    return ch;
+}
+
+/**
+ * A read of the block, for a cache miss at cycle now
+ * @return the cycle the whole block is there
+ */
+unsigned long long dramRead(struct DRAM *d, unsigned int block, unsigned long long now) {
+    unsigned long long id, served, picked, done;
+    struct DRAMChannel *ch = dramEnqueue(d, block, 0, &now, &id);
+    do {
+        done = dramServeNext(d, ch, &served, &picked);
+    } while (served != id);
+    return done;
+}
+
+/**
+ * A write to the block, posted at cycle *now, which is advanced if the store has to wait for room in the queue
+ */
+void dramWrite(struct DRAM *d, unsigned int block, unsigned long long *now) {
+    unsigned long long id;
+    dramEnqueue(d, block, 1, now, &id);
+}
+
+/**
+ * End of the run: serve the writes still queued
+ */
+void dramFinish(struct DRAM *d) {
+    unsigned long long served, picked;
+    int c;
+    for (c = 0; c < d->channels; c++) {
+        while (d->channel[c].count > 0) dramServeNext(d, &d->channel[c], &served, &picked);
+    }
+}
+
+/**
+ * Bandwidth utilization is the share of the cycles, up to the last data, that the data buses carried data
+ */
+void printDRAMSummary(FILE *file, struct DRAM *d) {
+    unsigned long long requests = d->reads + d->writes, busy = 0;
+    int c;
+    for (c = 0; c < d->channels; c++) busy += d->channel[c].busyCycles;
+    fprintf(file, "\t DRAM (%d channels, %d banks, %d-byte rows, %s page, %d:%d:%d:%d): Reads: %llu, Writes: %llu, Row Hits: %llu, Row Empty: %llu, Row Conflicts: %llu, Row Hit Rate: %.2f, Average Read Latency: %.1f cycles, Bandwidth Utilization: %.2f%%\n",
+            d->channels, d->banks, d->rowBytes, d->closedPage ? "closed" : "open", d->tRCD, d->tCL, d->tRP, d->tBurst,
+            d->reads, d->writes, d->rowHits, d->rowEmpty, d->rowConflicts,
+            requests ? ((double)d->rowHits)/requests : 0.0, d->reads ? ((double)d->readCycles)/d->reads : 0.0,
+            d->lastDone ? 100.0*busy/((double)d->channels*d->lastDone) : 0.0);
+}
+
+/* parse a TLB geometry given as <entries>:<ways>, entries a power of two multiple of ways, 0 entries for none */
+static int setTLBGeometry(struct TLB *t, const char *value) {
+    int entries, ways;
+    char extra;
+    if (sscanf(value, "%d:%d%c", &entries, &ways, &extra) != 2) return 0;
+    if (entries < 0 || (entries & (entries - 1)) || ways <= 0 || ways > MAX_TLB_WAYS || (ways & (ways - 1)) ||
+        (entries > 0 && entries < ways)) return 0;
+    t->numEntries = entries;
+    t->numWays = ways;
+    return 1;
+}
+
+/**
+ * Set one of the address translation options of cpusim_cachesim (--mmu, --dtlb, ...).
+ * @return 1 on success, 0 if the value is invalid, -1 if key is not an MMU option
+ */
+int setMMUOption(const char *key, const char *value) {
+    char *end;
+    if (strcmp(key, "mmu") == 0) {
+        DMMU.enabled = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "dtlb") == 0) {
+        return setTLBGeometry(&DMMU.l1, value) && DMMU.l1.numEntries > 0;
+    } else if (strcmp(key, "l2tlb") == 0) {
+        return setTLBGeometry(&DMMU.l2, value);
+    } else if (strcmp(key, "huge-pages") == 0) {
+        DMMU.hugePages = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "walk-latency") == 0) {
+        DMMU.walkLatency = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && DMMU.walkLatency >= 0;
+    }
+    return -1;
+}
+
+void printMMUOptions() {
+    printf("  --mmu <0|1>         translate the data addresses through TLBs and a page table (default 0)\n"
+           "  --dtlb <e>:<w>      L1 data TLB with e entries, w ways (default 64:4)\n"
+           "  --l2tlb <e>:<w>     L2 TLB behind it, 7 cycles a hit, 0 entries for none (default 1024:8)\n"
+           "  --huge-pages <0|1>  map the data memory with 4 MB pages instead of 4 KB ones (default 0)\n"
+           "  --walk-latency <n>  cycles per page table level a TLB miss reads (default 30)\n");
+}
+
+static void initTLB(struct TLB *t) {
+    size_t n = (size_t)t->numEntries;
+    t->numSets = t->numEntries/t->numWays;
+    t->page = (unsigned int*) calloc(n ? n : 1, sizeof(unsigned int));
+    t->frame = (unsigned int*) calloc(n ? n : 1, sizeof(unsigned int));
+    t->lastUse = (unsigned long long*) calloc(n ? n : 1, sizeof(unsigned long long));
+    t->useClock = 0;
+}
+
+/**
+ * Map the memoryBytes of the data memory, frame for page, into the page table of the process and allocate the
+ * TLBs of the MMU. The MMU of another core is a copy of DMMU given memoryBytes 0, it only needs its own TLBs.
+ */
+void initMMU(struct MMU *m, unsigned long long memoryBytes) {
+    struct PageTable *pt = m->pageTable;
+    unsigned long long addr;
+    int i;
+    initTLB(&m->l1);
+    initTLB(&m->l2);
+    for (addr = 0; addr < memoryBytes && addr < (1ull << 32); addr += 1ull << HUGE_PAGE_SHIFT) {
+        unsigned int d = (unsigned int)(addr >> HUGE_PAGE_SHIFT);
+        if (m->hugePages) {
+            pt->directory[d] = (unsigned int)addr | PTE_HUGE | PTE_PRESENT;
+            continue;
+        }
+        pt->directory[d] = PTE_PRESENT;
+        pt->table[d] = (unsigned int*) calloc(PT_ENTRIES, sizeof(unsigned int));
+        pt->numTables++;
+        for (i = 0; i < PT_ENTRIES && addr + ((unsigned long long)i << PAGE_SHIFT) < memoryBytes; i++) {
+            pt->table[d][i] = (unsigned int)(addr + ((unsigned long long)i << PAGE_SHIFT)) | PTE_PRESENT;
+        }
+    }
+}
+
+/* look the page up in the TLB, LRU within a set */
+static inline int tlbLookup(struct TLB *t, unsigned int page, unsigned int *frame) {
+    size_t base = (size_t)(page & (t->numSets - 1))*t->numWays;
+    int w;
+    for (w = 0; w < t->numWays; w++) {
+        if (t->page[base + w] == page + 1) {
+            t->lastUse[base + w] = ++t->useClock;
+            *frame = t->frame[base + w];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline void tlbInsert(struct TLB *t, unsigned int page, unsigned int frame) {
+    size_t base = (size_t)(page & (t->numSets - 1))*t->numWays, lru = base;
+    int w;
+    for (w = 1; w < t->numWays; w++) {
+        if (t->lastUse[base + w] < t->lastUse[lru]) lru = base + w;
+    }
+    t->page[lru] = page + 1;
+    t->frame[lru] = frame;
+    t->lastUse[lru] = ++t->useClock;
+}
+
+/**
+ * Walk the page table for addr, as the hardware walker does
+ * @param frame  set to the frame address mapped, the address itself for a page not mapped
+ * @return the number of levels read
+ */
+static int pageWalk(struct MMU *m, unsigned int addr, unsigned int *frame) {
+    unsigned int pde = m->pageTable->directory[addr >> HUGE_PAGE_SHIFT];
+    unsigned int shift = m->hugePages ? HUGE_PAGE_SHIFT : PAGE_SHIFT;
+    if (pde & PTE_HUGE) {
+        *frame = pde & ~((1u << HUGE_PAGE_SHIFT) - 1);
+        return 1;
+    }
+    unsigned int pte = pde & PTE_PRESENT ? m->pageTable->table[addr >> HUGE_PAGE_SHIFT][(addr >> PAGE_SHIFT) & (PT_ENTRIES - 1)] : 0;
+    if (!(pte & PTE_PRESENT)) {   /* outside the data memory, the access itself fails */
+        m->faults++;
+        *frame = addr & ~((1u << shift) - 1);
+        return pde & PTE_PRESENT ? 2 : 1;
+    }
+    *frame = pte & ~((1u << PAGE_SHIFT) - 1);
+    return 2;
+}
+
+/**
+ * Translate a data address.
+ * @param physical set to the physical address
+ * @return the cycles the translation took, 0 for an L1 TLB hit
+ */
+unsigned int mmuTranslate(struct MMU *m, unsigned int addr, unsigned int *physical) {
+    unsigned int shift = m->hugePages ? HUGE_PAGE_SHIFT : PAGE_SHIFT, page = addr >> shift, frame, cycles = 0;
+    m->accesses++;
+    if (tlbLookup(&m->l1, page, &frame)) {
+        m->l1Hits++;
+    } else {
+        if (m->l2.numEntries > 0) cycles = m->l2Latency;
+        if (m->l2.numEntries > 0 && tlbLookup(&m->l2, page, &frame)) {
+            m->l2Hits++;
+        } else {
+            unsigned int walk = m->walkLatency*pageWalk(m, addr, &frame);
+            m->walks++;
+            m->walkCycles += walk;
+            cycles += walk;
+            if (m->l2.numEntries > 0) tlbInsert(&m->l2, page, frame);
+        }
+        tlbInsert(&m->l1, page, frame);
+    }
+    *physical = frame | (addr & ((1u << shift) - 1));
+    return cycles;
+}
+
+void printMMUSummary(FILE *file, struct MMU *m) {
+    unsigned long long l1Misses = m->accesses - m->l1Hits;
+    fprintf(file, "\t Data TLB (L1 %d entries %d ways, L2 %d entries %d ways, %s pages): Accesses: %llu, L1 Hits: %llu, L2 Hits: %llu, Page Walks: %llu, L1 Hit Ratio: %.2f, L2 Hit Ratio: %.2f, Walk Cycles: %llu, Page Tables: %d, Page Faults: %llu\n",
+            m->l1.numEntries, m->l1.numWays, m->l2.numEntries, m->l2.numWays, m->hugePages ? "4 MB" : "4 KB",
+            m->accesses, m->l1Hits, m->l2Hits, m->walks, m->accesses ? ((double)m->l1Hits)/m->accesses : 0.0,
+            l1Misses ? ((double)m->l2Hits)/l1Misses : 0.0, m->walkCycles, m->pageTable->numTables, m->faults);
+}
+
+/**
+ * Join the coherence bus, once the cache is initialized
+ */
+void attachToBus(struct Cache *c) {
+    size_t ways = (size_t)c->numSets*c->numWays;
+    c->bus = &Bus;
+    c->state = (unsigned char*) calloc(ways, 1);
+    c->invalidatedAt = (unsigned long long*) calloc(ways, sizeof(unsigned long long));
+    c->touchedWords = (unsigned short*) calloc(ways, sizeof(unsigned short));
+    c->lastBusRequest = (int*) calloc(ways, sizeof(int));
+    Bus.blockWords = c->blockBytes/4;
+    Bus.cache[Bus.numCaches++] = c;
+}
+
+static void growSharedBlocks(struct CoherenceBus *b) {
+    unsigned long long mask = b->sharedKeys ? b->sharedMask*2 + 1 : 1023, i, h;
+    unsigned int *keys = (unsigned int*) calloc(mask + 1, sizeof(unsigned int));
+    unsigned long long *stamps = (unsigned long long*) calloc((mask + 1)*b->blockWords, sizeof(unsigned long long));
+    for (i = 0; b->sharedKeys && i <= b->sharedMask; i++) {
+        if (!b->sharedKeys[i]) continue;
+        for (h = ((b->sharedKeys[i] - 1) * 0x9E3779B97F4A7C15ULL) >> 17; keys[h & mask]; h++);
+        keys[h & mask] = b->sharedKeys[i];
+        memcpy(&stamps[(h & mask)*b->blockWords], &b->sharedStamps[i*b->blockWords], b->blockWords*sizeof(unsigned long long));
+    }
+    free(b->sharedKeys);
+    free(b->sharedStamps);
+    b->sharedKeys = keys;
+    b->sharedStamps = stamps;
+    b->sharedMask = mask;
+}
+
+/**
+ * The last write times of the words of a block
+ * @param create add the block, with no word written yet, if it is not there
+ * @return NULL if the block has not been invalidated before (and create is 0)
+ */
+static unsigned long long *sharedBlockStamps(struct CoherenceBus *b, unsigned int block, int create) {
+    unsigned long long h;
+    if (create && (b->sharedKeys == NULL || (b->sharedUsed + 1)*2 > b->sharedMask + 1)) growSharedBlocks(b);
+    if (b->sharedKeys == NULL) return NULL;
+    for (h = (block * 0x9E3779B97F4A7C15ULL) >> 17;; h++) {
+        unsigned long long slot = h & b->sharedMask;
+        if (b->sharedKeys[slot] == block + 1) return &b->sharedStamps[slot*b->blockWords];
+        if (b->sharedKeys[slot] == 0) {
+            if (!create) return NULL;
+            b->sharedKeys[slot] = block + 1;
+            b->sharedUsed++;
+            return &b->sharedStamps[slot*b->blockWords];
+        }
+    }
+}
+
+/**
+ * During coherenceReplay(), whether cache c has a request for block, held in its way w, still to replay. The
+ * entry of lastBusRequest may be left from an earlier epoch, it only counts if it points to a request for
+ * that block in this epoch's log.
+ */
+static int laterBusRequest(const struct Cache *c, size_t w, unsigned int block) {
+    int last = c->lastBusRequest[w];
+    return last > c->busLogPos && last <= c->busLogCount && c->busLog[last - 1].block == block;
+}
+
+/**
+ * Snoop a bus transaction of cache c in all the other caches (and their victim caches)
+ * @param invalidate 1 for a BusRdX or BusUpgr, the other copies are invalidated; 0 for a BusRd, a Modified
+ *                   or Exclusive copy becomes Shared
+ * @param word the word of the block written, for an invalidation
+ * @return 1 if another cache held the block
+ */
+static int snoop(struct Cache *c, unsigned int block, int invalidate, unsigned int word) {
+    struct CoherenceBus *b = c->bus;
+    int i, shared = 0;
+    for (i = 0; i < b->numCaches; i++) {
+        struct Cache *o = b->cache[i];
+        if (o == c) continue;
+        if (o->victim != NULL && victimProbe(o->victim, block, invalidate)) shared = 1;
+        int way = cacheLookup(o, block);
+        if (way < 0) continue;
+        unsigned int set = CacheSetOf(o, block);
+        size_t w = (size_t)set*o->numWays + way;
+        if (b->deferred && laterBusRequest(o, w, block)) {
+            /* the copy came in or was written after this request and stays, with the words c wrote */
+            if (invalidate) memcpy(CacheBlockData(o, set, way), &o->memory[(size_t)block << o->blockShift], o->blockBytes);
+            continue;
+        }
+        shared = 1;
+        if (o->state[w] == MESI_MODIFIED) b->transfers++;
+        if (!invalidate) {
+            o->state[w] = MESI_SHARED;
+            continue;
+        }
+        o->prefetcher->useless += (o->prefetchedBits[set] >> way) & 1;
+        o->validBits[set] &= ~(1u << way);
+        o->prefetchedBits[set] &= ~(1u << way);
+        o->state[w] = MESI_INVALID;
+        o->invalidatedAt[w] = b->clock;
+        o->invalidations++;
+        o->falseInvalidations += !((o->touchedWords[w] >> word) & 1);
+        sharedBlockStamps(b, block, 1);
+    }
+    return shared;
+}
+
+/**
+ * Log a request of cache c, for coherenceReplay()
+ */
+static void logBusRequest(struct Cache *c, int kind, unsigned int block, unsigned int word) {
+    if (c->busLogCount == c->busLogCapacity) {
+        c->busLogCapacity = c->busLogCapacity ? c->busLogCapacity*2 : 1024;
+        c->busLog = (struct BusRequest*) realloc(c->busLog, c->busLogCapacity*sizeof(struct BusRequest));
+    }
+    struct BusRequest *r = &c->busLog[c->busLogCount++];
+    r->key = c->busKey;
+    r->block = block;
+    r->kind = (unsigned char)kind;
+    r->word = (unsigned char)word;
+}
+
+/**
+ * The MESI state of a block that has just been put in way of the set: Modified after the BusRdX of a write
+ * miss, otherwise the fill is a BusRd
+ */
+static void coherenceFill(struct Cache *c, unsigned int set, int way, unsigned int block) {
+    struct CoherenceBus *b = c->bus;
+    const unsigned int *tags = &c->tags[(size_t)set*c->wayStride];
+    int w;
+    for (w = 0; w < c->numWays; w++) {
+        if (tags[w] == block) c->invalidatedAt[(size_t)set*c->numWays + w] = 0;
+    }
+    c->touchedWords[(size_t)set*c->numWays + way] = 0;
+    if (c->claimed) {
+        c->claimed = 0;
+        c->state[(size_t)set*c->numWays + way] = MESI_MODIFIED;
+    } else if (b->deferred) {
+        logBusRequest(c, BUS_RD, block, 0);
+        c->state[(size_t)set*c->numWays + way] = MESI_EXCLUSIVE;
+    } else {
+        b->busRd++;
+        c->state[(size_t)set*c->numWays + way] = snoop(c, block, 0, 0) ? MESI_SHARED : MESI_EXCLUSIVE;
+    }
+}
+
+/**
+ * The bus side of a demand access, before the cache serves it: classify a coherence miss, get ownership
+ * for a write and time stamp the word written
+ * @param way the way holding the block, -1 on a miss
+ */
+static void coherenceAccess(struct Cache *c, unsigned int set, unsigned int block, unsigned int addr, int way, int isWrite) {
+    struct CoherenceBus *b = c->bus;
+    unsigned int word = (addr & (c->blockBytes - 1)) >> 2;
+    int w;
+    if (isWrite && !b->deferred) b->clock++;
+    if (way >= 0) {
+        unsigned char *state = &c->state[(size_t)set*c->numWays + way];
+        if (isWrite && b->deferred) {
+            logBusRequest(c, BUS_WRITE, block, word);
+        } else if (isWrite && *state == MESI_SHARED) {
+            b->busUpgr++;
+            snoop(c, block, 1, word);
+        }
+        if (isWrite) *state = MESI_MODIFIED;
+    } else {
+        const unsigned int *tags = &c->tags[(size_t)set*c->wayStride];
+        for (w = 0; w < c->numWays; w++) {
+            unsigned long long *invalidatedAt = &c->invalidatedAt[(size_t)set*c->numWays + w];
+            if (tags[w] != block || *invalidatedAt == 0 || ((c->validBits[set] >> w) & 1)) continue;
+            c->coherenceMisses++;
+            if (sharedBlockStamps(b, block, 0)[word] >= *invalidatedAt) c->trueSharing++; else c->falseSharing++;
+            *invalidatedAt = 0;
+            break;
+        }
+        if (isWrite && b->deferred) {
+            logBusRequest(c, BUS_RDX, block, word);
+        } else if (isWrite) {
+            b->busRdX++;
+            snoop(c, block, 1, word);
+        }
+        c->claimed = isWrite;
+    }
+    if (isWrite && !b->deferred) {
+        unsigned long long *stamps = sharedBlockStamps(b, block, 0);
+        if (stamps != NULL) stamps[word] = b->clock;
+    }
+}
+
+/**
+ * End of an epoch of a deferred bus: snoop the requests the caches logged, merged in the order of their keys
+ */
+void coherenceReplay() {
+    int i, j;
+    for (i = 0; i < Bus.numCaches; i++) {
+        struct Cache *c = Bus.cache[i];
+        c->busLogPos = 0;
+        for (j = 0; j < c->busLogCount; j++) {
+            int way = cacheLookup(c, c->busLog[j].block);
+            if (way >= 0) c->lastBusRequest[(size_t)CacheSetOf(c, c->busLog[j].block)*c->numWays + way] = j + 1;
+        }
+    }
+    for (;;) {
+        unsigned long long key = ~0ULL;
+        for (i = 0; i < Bus.numCaches; i++) {
+            struct Cache *c = Bus.cache[i];
+            if (c->busLogPos < c->busLogCount && c->busLog[c->busLogPos].key < key) key = c->busLog[c->busLogPos].key;
+        }
+        if (key == ~0ULL) break;
+        for (i = 0; i < Bus.numCaches; i++) {
+            struct Cache *c = Bus.cache[i];
+            for (; c->busLogPos < c->busLogCount && c->busLog[c->busLogPos].key == key; c->busLogPos++) {
+                const struct BusRequest *r = &c->busLog[c->busLogPos];
+                int way = cacheLookup(c, r->block);
+                unsigned char *state = way >= 0 ? &c->state[(size_t)CacheSetOf(c, r->block)*c->numWays + way] : NULL;
+                if (r->kind == BUS_RD) {
+                    Bus.busRd++;
+                    if (snoop(c, r->block, 0, 0) && state != NULL && *state == MESI_EXCLUSIVE) *state = MESI_SHARED;
+                    continue;
+                }
+                Bus.clock++;
+                if (r->kind == BUS_RDX) {
+                    Bus.busRdX++;
+                    snoop(c, r->block, 1, r->word);
+                } else if (snoop(c, r->block, 1, r->word)) {
+                    Bus.busUpgr++;
+                }
+                if (state != NULL) *state = MESI_MODIFIED;
+                unsigned long long *stamps = sharedBlockStamps(&Bus, r->block, 0);
+                if (stamps != NULL) stamps[r->word] = Bus.clock;
+            }
+        }
+    }
+    for (i = 0; i < Bus.numCaches; i++) Bus.cache[i]->busLogCount = 0;
+}
+
+void printCoherenceSummary(FILE *file) {
+    unsigned long long writebacks = 0;
+    int i;
+    if (Bus.numCaches == 0) return;
+    for (i = 0; i < Bus.numCaches; i++) writebacks += Bus.cache[i]->writebacks;
+    fprintf(file, "\t Coherence (MESI, %d data caches): BusRd: %llu, BusRdX: %llu, BusUpgr: %llu, Cache-to-cache Transfers: %llu, Writebacks: %llu\n",
+            Bus.numCaches, Bus.busRd, Bus.busRdX, Bus.busUpgr, Bus.transfers, writebacks);
+    for (i = 0; i < Bus.numCaches; i++) {
+        struct Cache *c = Bus.cache[i];
+        fprintf(file, "\t Core %d Data Cache: Invalidations: %llu (False Sharing: %llu), Coherence Misses: %llu (True Sharing: %llu, False Sharing: %llu)\n",
+                i, c->invalidations, c->falseInvalidations, c->coherenceMisses, c->trueSharing, c->falseSharing);
+    }
+}
+
+/**
+ * A demand access to a cache: look the block up, classify and serve a miss through the victim cache, the
+ * stream buffers or memory, and train the prefetcher.
+ * @param pc the PC of the instruction making the access (for the stride prefetcher)
+ * @param isWrite 1 for a store, which needs the block Modified when the cache is on the coherence bus
+ * @param outcome set to one of CACHE_HIT, CACHE_STREAM_HIT, CACHE_VICTIM_HIT or CACHE_MISS
+ * @return the payload of the block, which is in the cache after the call
+ */
+unsigned int *cacheAccess(struct Cache *c, unsigned int addr, unsigned int pc, int isWrite, int *outcome) {
+    unsigned int block = addr >> c->blockShift;
+    unsigned int set = CacheSetOf(c, block);
+    struct Prefetcher *p = c->prefetcher;
+    int evictedUnused;
+    if (p->kind) prefetchTick(p);
+    int way = cacheLookup(c, block);
+    if (c->bus != NULL) coherenceAccess(c, set, block, addr, way, isWrite);
+    if (way >= 0) {
+        *outcome = CACHE_HIT;
+        if (c->missClass->enabled) classifyAccess(c->missClass, block, 0);
+        int firstUse = cacheTouch(c, set, way);
+        if (c->bus != NULL) c->touchedWords[(size_t)set*c->numWays + way] |= 1u << ((addr & (c->blockBytes - 1)) >> 2);
+        if (p->kind) prefetchTrain(p, pc, addr, 0, firstUse);
+        return CacheBlockData(c, set, way);
+    }
+    unsigned int victimData[MAX_BLOCK_WORDS];
+    if (c->victim != NULL && victimLookup(c->victim, block, victimData)) {
+        *outcome = CACHE_VICTIM_HIT;
+        way = cacheFill(c, block, victimData, 0, &evictedUnused);
+    } else if (p->kind && prefetchOnMiss(p, block)) {
+        *outcome = CACHE_STREAM_HIT;
+        way = cacheFill(c, block, NULL, 0, &evictedUnused);
+    } else {
+        *outcome = CACHE_MISS;
+        way = cacheFill(c, block, NULL, 0, &evictedUnused);
+        if (p->kind) prefetchTrain(p, pc, addr, 1, 0);
+    }
+    if (c->missClass->enabled) classifyAccess(c->missClass, block, !CacheIsHit(*outcome));
+    p->useless += evictedUnused;
+    if (c->bus != NULL) c->touchedWords[(size_t)set*c->numWays + way] |= 1u << ((addr & (c->blockBytes - 1)) >> 2);
+    return CacheBlockData(c, set, way);
+}
+
+/**
+ * Set one of the cache options shared by cpusim_cachesim and cachesim (--icache, --dprefetch, ...).
+ * @return 1 on success, 0 if the value is invalid, -1 if key is not a cache option
+ */
+int setCacheOption(const char *key, const char *value) {
+    char *end;
+    if (strcmp(key, "iprefetch") == 0) {
+        return setPrefetchKind(&IPrefetch, value);
+    } else if (strcmp(key, "dprefetch") == 0) {
+        return setPrefetchKind(&DPrefetch, value);
+    } else if (strcmp(key, "prefetch-degree") == 0) {
+        IPrefetch.degree = DPrefetch.degree = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && IPrefetch.degree > 0;
+    } else if (strcmp(key, "prefetch-latency") == 0) {
+        IPrefetch.latency = DPrefetch.latency = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && IPrefetch.latency >= 0;
+    } else if (strcmp(key, "stream-buffers") == 0) {
+        IPrefetch.numStreams = DPrefetch.numStreams = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && IPrefetch.numStreams > 0 && IPrefetch.numStreams <= MAX_STREAM_BUFFERS;
+    } else if (strcmp(key, "stream-depth") == 0) {
+        IPrefetch.streamDepth = DPrefetch.streamDepth = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && IPrefetch.streamDepth > 0 && IPrefetch.streamDepth <= MAX_STREAM_DEPTH;
+    } else if (strcmp(key, "classify-misses") == 0) {
+        IMissClass.enabled = DMissClass.enabled = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "icache") == 0) {
+        return setCacheGeometry(&InstructionCache, value);
+    } else if (strcmp(key, "dcache") == 0) {
+        return setCacheGeometry(&DataCache, value);
+    } else if (strcmp(key, "ivictim") == 0) {
+        IVictim.numEntries = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && IVictim.numEntries >= 0 && IVictim.numEntries <= MAX_VICTIM_ENTRIES;
+    } else if (strcmp(key, "dvictim") == 0) {
+        DVictim.numEntries = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && DVictim.numEntries >= 0 && DVictim.numEntries <= MAX_VICTIM_ENTRIES;
+    }
+    return -1;
+}
+
+void printCacheOptions() {
+    printf("  --iprefetch <kind>  instruction cache prefetcher: none, next-line or stream (default none)\n"
+           "  --dprefetch <kind>  data cache prefetcher: none, next-line, stride or stream (default none)\n"
+           "  --prefetch-degree <n> blocks prefetched ahead by next-line and stride (default 1)\n"
+           "  --prefetch-latency <n> cache accesses before a prefetched block arrives (default 0)\n"
+           "  --stream-buffers <n> number of stream buffers per cache (default 4)\n"
+           "  --stream-depth <n>  blocks per stream buffer (default 4)\n"
+           "  --icache <s>:<w>:<b> instruction cache with s sets, w ways, b-byte blocks (default 4:1:8)\n"
+           "  --dcache <s>:<w>:<b> data cache with s sets, w ways, b-byte blocks (default 64:1:16)\n"
+           "  --classify-misses <0|1> classify cache misses as compulsory, capacity or conflict (default 0)\n"
+           "  --ivictim <n>       entries of the instruction victim cache, 0 disables it (default 0, max 16)\n"
+           "  --dvictim <n>       entries of the data victim cache, 0 disables it (default 0, max 16)\n");
+}
+
+/**
+ * Allocate the caches once their options are set, hook up the victim caches and the miss classifiers
+ */
+void initCaches(char *instructionMemory, unsigned long long instructionBytes, char *dataMemory, unsigned long long dataBytes) {
+    initCache(&InstructionCache, instructionMemory, instructionBytes);
+    initCache(&DataCache, dataMemory, dataBytes);
+    if (IVictim.numEntries) {
+        IVictim.blockWords = InstructionCache.blockBytes/4;
+        InstructionCache.victim = &IVictim;
+    }
+    if (DVictim.numEntries) {
+        DVictim.blockWords = DataCache.blockBytes/4;
+        DataCache.victim = &DVictim;
+    }
+    initMissClassifier(&IMissClass, &InstructionCache);
+    initMissClassifier(&DMissClass, &DataCache);
+}
+
+/**
+ * End of the run: the prefetches that were never used are counted as useless
+ */
+void finishCaches() {
+    prefetchFinish(&IPrefetch, cacheUnusedPrefetches(&InstructionCache));
+    prefetchFinish(&DPrefetch, cacheUnusedPrefetches(&DataCache));
+    if (Dram.enabled) dramFinish(&Dram);
+}
+
+/**
+ * Set up the private caches of another core as copies of the configured InstructionCache and DataCache and
+ * their prefetchers, miss classifiers and victim caches. initCaches() must have been called.
+ */
+void initCoreCaches(struct CoreCaches *cc) {
+    cc->icache = InstructionCache;
+    cc->dcache = DataCache;
+    cc->iprefetch = IPrefetch;
+    cc->dprefetch = DPrefetch;
+    cc->imissClass = IMissClass;
+    cc->dmissClass = DMissClass;
+    cc->ivictim = IVictim;
+    cc->dvictim = DVictim;
+    cc->iprefetch.cache = &cc->icache;
+    cc->dprefetch.cache = &cc->dcache;
+    cc->icache.prefetcher = &cc->iprefetch;
+    cc->dcache.prefetcher = &cc->dprefetch;
+    cc->icache.missClass = &cc->imissClass;
+    cc->dcache.missClass = &cc->dmissClass;
+    cc->icache.victim = IVictim.numEntries ? &cc->ivictim : NULL;
+    cc->dcache.victim = DVictim.numEntries ? &cc->dvictim : NULL;
+    cc->dmshr = DMSHR;
+    cc->dcache.mshr = DataCache.mshr != NULL ? &cc->dmshr : NULL;
+    cc->dmmu = DMMU;
+    cc->dcache.mmu = DataCache.mmu != NULL ? &cc->dmmu : NULL;
+    if (DataCache.mmu != NULL) initMMU(&cc->dmmu, 0);
+    initCache(&cc->icache, InstructionCache.memory, (unsigned long long)InstructionCache.memoryBlocks << InstructionCache.blockShift);
+    initCache(&cc->dcache, DataCache.memory, (unsigned long long)DataCache.memoryBlocks << DataCache.blockShift);
+    initMissClassifier(&cc->imissClass, &cc->icache);
+    initMissClassifier(&cc->dmissClass, &cc->dcache);
+}
+
+/**
+ * End of the run for the caches of another core: finish the prefetchers and add the prefetcher, miss
+ * classification and victim cache counts to those of InstructionCache and DataCache, which the summary prints
+ */
+void finishCoreCaches(struct CoreCaches *cc) {
+    struct Prefetcher *from[2] = { &cc->iprefetch, &cc->dprefetch }, *to[2] = { &IPrefetch, &DPrefetch };
+    struct MissClassifier *mcFrom[2] = { &cc->imissClass, &cc->dmissClass }, *mcTo[2] = { &IMissClass, &DMissClass };
+    struct VictimCache *vFrom[2] = { &cc->ivictim, &cc->dvictim }, *vTo[2] = { &IVictim, &DVictim };
+    int i;
+    prefetchFinish(&cc->iprefetch, cacheUnusedPrefetches(&cc->icache));
+    prefetchFinish(&cc->dprefetch, cacheUnusedPrefetches(&cc->dcache));
+    for (i = 0; i < 2; i++) {
+        to[i]->issued += from[i]->issued;
+        to[i]->useful += from[i]->useful;
+        to[i]->late += from[i]->late;
+        to[i]->useless += from[i]->useless;
+        mcTo[i]->compulsory += mcFrom[i]->compulsory;
+        mcTo[i]->capacity += mcFrom[i]->capacity;
+        mcTo[i]->conflict += mcFrom[i]->conflict;
+        vTo[i]->probes += vFrom[i]->probes;
+        vTo[i]->hits += vFrom[i]->hits;
+    }
+    DMSHR.primary += cc->dmshr.primary;
+    DMSHR.secondary += cc->dmshr.secondary;
+    DMSHR.hitsUnderMiss += cc->dmshr.hitsUnderMiss;
+    DMSHR.missesUnderMiss += cc->dmshr.missesUnderMiss;
+    DMSHR.fullStalls += cc->dmshr.fullStalls;
+    DMSHR.missCycles += cc->dmshr.missCycles;
+    DMSHR.busyCycles += cc->dmshr.busyCycles;
+    DMMU.accesses += cc->dmmu.accesses;
+    DMMU.l1Hits += cc->dmmu.l1Hits;
+    DMMU.l2Hits += cc->dmmu.l2Hits;
+    DMMU.walks += cc->dmmu.walks;
+    DMMU.walkCycles += cc->dmmu.walkCycles;
+    DMMU.faults += cc->dmmu.faults;
+}
+
+/**
+ * The prefetcher, miss classification and victim cache lines of the summary, for the ones that are enabled
+ */
+void printCacheSummary(FILE *file) {
+    printPrefetchSummary(file, &IPrefetch);
+    printPrefetchSummary(file, &DPrefetch);
+    printMissClassSummary(file, "Instruction", &IMissClass);
+    printMissClassSummary(file, "Data", &DMissClass);
+    printVictimSummary(file, "Instruction", &IVictim);
+    printVictimSummary(file, "Data", &DVictim);
+    if (DataCache.mshr != NULL) printMSHRSummary(file, "Data", &DMSHR);
+    if (Dram.enabled) printDRAMSummary(file, &Dram);
+    if (DataCache.mmu != NULL) printMMUSummary(file, &DMMU);
+    printCoherenceSummary(file);
+}
@@ -0,0 +1,413 @@
+#ifndef CACHEMODEL_H
+#define CACHEMODEL_H
+
+#include <stdio.h>
+
+/**
+ * Cache model. A cache has numSets sets of numWays ways with blockBytes-byte blocks and LRU replacement;
+ * the default InstructionCache (4 sets, 1 way, 2-word blocks) and DataCache (64 sets, 1 way, 4-word blocks)
+ * are the direct-mapped caches of the project.
+ * The state is kept as a structure of arrays: the tags of a set are contiguous (padded to CACHE_WAY_ALIGN
+ * ways) so a lookup compares all the ways of a set with a few SIMD instructions, the valid and prefetched
+ * bits of a set are one word each, and the block payloads live in a separate arena that a lookup never
+ * touches. A tag is the whole block number (address >> block bits) so no index bits need to be stripped.
+ */
+#define CACHE_WAY_ALIGN 8
+#define MAX_CACHE_WAYS 32
+#define MAX_BLOCK_WORDS 16
+
+struct Prefetcher;
+struct VictimCache;
+struct MissClassifier;
+struct CoherenceBus;
+struct MSHRFile;
+struct MMU;
+
+struct Cache {
+    const char *name;
+    int numSets;
+    int numWays;
+    int blockBytes;
+    int blockShift;                  // log2(blockBytes)
+    int wayStride;                   // numWays rounded up to CACHE_WAY_ALIGN, the row length of tags
+    char *memory;                    // the memory behind the cache
+    unsigned int memoryBlocks;       // blocks in that memory
+    unsigned int *tags;              // [numSets][wayStride] block number held by each way
+    unsigned int *validBits;         // [numSets] bit w is set if way w holds a block
+    unsigned int *prefetchedBits;    // [numSets] bit w is set if way w was prefetched and not used yet
+    unsigned long long *lastUse;     // [numSets][numWays] LRU time stamps
+    unsigned long long useClock;
+    unsigned int *arena;             // [numSets][numWays][blockBytes/4] block payloads
+    struct Prefetcher *prefetcher;
+    struct VictimCache *victim;
+    struct MissClassifier *missClass;
+    struct MSHRFile *mshr;           // NULL unless the timing model is on
+    struct MMU *mmu;                 // NULL unless the addresses are translated, they are virtual then
+
+    struct CoherenceBus *bus;        // NULL unless the cache is kept coherent with the caches of other cores
+    int claimed;                     // a write miss has done its BusRdX, the fill that follows takes the block Modified
+    unsigned long long busKey;       // with a deferred bus, the order of the requests logged now
+    struct BusRequest *busLog;       // the requests logged while the bus is deferred
+    int busLogCount, busLogCapacity;
+    int busLogPos;                   // during coherenceReplay(), the next request of busLog to put on the bus
+    int *lastBusRequest;             // [numSets][numWays] 1 + the index in busLog of the last request for the block
+    unsigned char *state;            // [numSets][numWays] MESI state, with a bus
+    unsigned long long *invalidatedAt; // [numSets][numWays] bus clock when the way lost its block to an invalidation
+    unsigned short *touchedWords;    // [numSets][numWays] words of the block accessed since it came in
+    unsigned long long invalidations;  // blocks taken away by the writes of other cores
+    unsigned long long falseInvalidations; // of those, the ones for a write to a word this core never accessed
+    unsigned long long coherenceMisses, trueSharing, falseSharing;
+    unsigned long long writebacks;   // Modified blocks evicted
+};
+
+#define CacheSetOf(c, block)          ((block) & ((c)->numSets - 1))
+#define CacheBlockData(c, set, way)   (&(c)->arena[((size_t)(set)*(c)->numWays + (way))*((c)->blockBytes >> 2)])
+
+/**
+ * Hardware prefetchers. One prefetcher can be attached to each of the InstructionCache and the DataCache:
+ *   next-line: on a miss, or on the first demand use of a prefetched block, prefetch the next <degree> blocks
+ *   stride:    (DataCache only) a 64-entry PC-indexed reference prediction table, once a load/store has shown
+ *              the same stride twice the blocks <degree> strides ahead are prefetched
+ *   stream:    <streamBuffers> stream buffers of <streamDepth> blocks each, sitting beside the cache. A miss
+ *              that hits in a stream buffer is served from it and the buffer is topped up; a miss that does
+ *              not allocates the least recently used buffer to the blocks after the miss.
+ * Time is counted in accesses to the cache, a prefetch issued at access t arrives at access t+latency.
+ * A prefetch is useful when a demand access uses it, late when a demand access needs it before it arrives,
+ * and useless when it is evicted (or dropped from its stream buffer) without being used.
+ */
+#define PREFETCH_NONE 0
+#define PREFETCH_NEXT_LINE 1
+#define PREFETCH_STRIDE 2
+#define PREFETCH_STREAM 3
+#define PREFETCH_QUEUE_SIZE 32
+#define STRIDE_TABLE_SIZE 64
+#define MAX_STREAM_BUFFERS 16
+#define MAX_STREAM_DEPTH 16
+
+struct PrefetchRequest {
+    unsigned int block;              // block number (address >> block bits)
+    unsigned long long readyAt;      // access count at which the block arrives
+};
+
+struct StrideEntry {
+    unsigned int pc;
+    unsigned int lastAddr;
+    int stride;
+    int confidence;                  // 0..3, prefetch when >= 2
+};
+
+struct StreamBuffer {
+    struct PrefetchRequest entry[MAX_STREAM_DEPTH];
+    int count;                       // valid entries, entry[0] is the head
+    unsigned long long lastUse;
+};
+
+struct Prefetcher {
+    const char *cacheName;
+    int kind;
+    int degree;
+    int latency;
+    struct Cache *cache;             // the cache prefetched into, prefetches never go past its memory
+
+    unsigned long long clock;        // accesses to the cache so far
+    struct PrefetchRequest inFlight[PREFETCH_QUEUE_SIZE];
+    int numInFlight;
+    struct StrideEntry strideTable[STRIDE_TABLE_SIZE];
+    struct StreamBuffer stream[MAX_STREAM_BUFFERS];
+    int numStreams;
+    int streamDepth;
+
+    unsigned long long issued;
+    unsigned long long useful;
+    unsigned long long late;
+    unsigned long long useless;
+};
+
+/**
+ * Miss classification (3C). Every demand access is also run through a shadow fully-associative LRU cache
+ * with the same number of blocks. A miss of the real cache (one a stream buffer did not serve, see
+ * CacheIsHit) is compulsory if the block was never accessed before, a capacity miss if the shadow cache
+ * misses too, and a conflict miss if only the direct-mapped placement made it miss.
+ */
+struct BlockSet {
+    unsigned int *slot;              // block number + 1, 0 is an empty slot
+    unsigned long long mask;
+    unsigned long long used;
+};
+
+struct MissClassifier {
+    int enabled;
+    int numBlocks;                   // capacity of the real cache in blocks
+    unsigned int *lru;               // shadow fully-associative cache, most recently used first
+    int count;
+    struct BlockSet seen;
+    unsigned long long compulsory;
+    unsigned long long capacity;
+    unsigned long long conflict;
+};
+
+/**
+ * Victim cache. A small fully-associative LRU cache behind an L1 that holds the blocks the L1 evicts. An L1
+ * miss that hits in the victim cache swaps the block back into the L1 instead of going to memory.
+ */
+#define MAX_VICTIM_ENTRIES 16
+
+struct VictimEntry {
+    unsigned int valid;
+    unsigned int block;              // block number (address >> block bits)
+    unsigned long long lastUse;
+    unsigned int data[MAX_BLOCK_WORDS];
+};
+
+struct VictimCache {
+    int numEntries;                  // 0 disables the victim cache
+    int blockWords;                  // block size of the L1 it sits behind
+    unsigned long long clock;
+    struct VictimEntry entry[MAX_VICTIM_ENTRIES];
+    unsigned long long probes;       // L1 misses looked up in the victim cache
+    unsigned long long hits;
+};
+
+/**
+ * MESI coherence between the data caches of the cores (cpusim_cachesim --cores). The caches snoop a shared
+ * bus: a read miss is a BusRd, after which the block is Exclusive if no other cache holds it and Shared
+ * otherwise; a write miss is a BusRdX and a write hit on a Shared block a BusUpgr, both invalidate the other
+ * copies, and the written block is Modified (an Exclusive one becomes Modified without a bus transaction).
+ * A cache holding the block Modified supplies it to a BusRd or BusRdX (a cache-to-cache transfer), and
+ * evicting a Modified block is a writeback. Underneath, the caches are still write-through, so DataMemory
+ * is always up to date. The bus counts are the ones a write-back MESI system would make.
+ * An invalidation is a false sharing one if the word written is not one the invalidated cache accessed while
+ * it held the block. A miss on a block the cache lost to an invalidation is a coherence miss: a true sharing
+ * miss if another core wrote the word accessed since, a false sharing miss if the invalidating writes were
+ * all to other words of the block. The bus clock counts data writes; the last write time of each word is kept
+ * for the blocks that have been invalidated at least once.
+ *
+ * Deferred bus (cpusim_cachesim --parallel, the cores run on host threads): during an epoch a cache only
+ * touches its own state. A read miss takes the block Exclusive and a write Modified, and the request is
+ * logged with the busKey of the access instead of being snooped. At the end of the epoch coherenceReplay()
+ * puts the logged requests on the bus, in the order of their keys and, for the same key, of the caches on
+ * the bus: a BusRd makes the other copies Shared (and the Exclusive block of the requester too if there are
+ * any), a BusRdX invalidates them, and a write hit is a BusUpgr when another cache still holds the block.
+ * A copy that another core wrote during the epoch is therefore gone by the next one, unless that core has a
+ * request for the block still to replay: its copy came in or was written later than the request snooped, so
+ * the snoop leaves it alone (refetching the words written from memory, which coherenceReplay() expects to be
+ * up to date with the stores of the epoch) and the last writer in key order ends up with the block Modified,
+ * as it would on a bus that is not deferred.
+ */
+#define MESI_INVALID 0
+#define MESI_SHARED 1
+#define MESI_EXCLUSIVE 2
+#define MESI_MODIFIED 3
+#define MAX_CORES 64
+
+#define BUS_RD 0                     // a read miss (or a prefetch) filled the block
+#define BUS_RDX 1                    // a write miss
+#define BUS_WRITE 2                  // a write hit, a BusUpgr if another cache holds the block
+
+struct BusRequest {
+    unsigned long long key;
+    unsigned int block;
+    unsigned char kind;              // BUS_*
+    unsigned char word;              // the word written
+};
+
+struct CoherenceBus {
+    int numCaches;
+    struct Cache *cache[MAX_CORES];
+    int blockWords;
+    int deferred;                    // the caches log their requests, coherenceReplay() puts them on the bus
+    unsigned long long clock;        // data writes so far
+    unsigned int *sharedKeys;        // open addressing on block number + 1, 0 is an empty slot
+    unsigned long long *sharedStamps;  // [slot][blockWords] clock of the last write to each word
+    unsigned long long sharedMask, sharedUsed;
+    unsigned long long busRd, busRdX, busUpgr, transfers;
+};
+
+/**
+ * DRAM behind the data cache, the memory side of the timing model (cpusim_cachesim --timing 1 --dram ...).
+ * Channels each have their own data bus and banks, a bank has a row buffer holding one row open. Consecutive
+ * rows of the address space go to consecutive channels, then banks (row:bank:channel:column), so a sequential
+ * stream stays in one row for rowBytes. A request to the open row only needs the column access (tCL, a row
+ * hit); to a precharged bank it opens the row first (tRCD + tCL); to a bank with another row open it closes
+ * that row too (tRP + tRCD + tCL, a row conflict). The data then takes the channel's bus for tBurst cycles.
+ * With the closed page policy every access precharges its bank right after, so there are no row hits and
+ * no conflicts. Requests wait in a per-channel queue served FR-FCFS: of the requests there when the channel
+ * decides, those hitting an open row first, then the oldest. Read misses of the data cache are requests
+ * whose data the cache waits for; the cache is write-through, so every store is a write request too, posted
+ * (the store only waits when the queue is full) and drained when the scheduler picks it.
+ */
+#define MAX_DRAM_CHANNELS 8
+#define MAX_DRAM_BANKS 16
+#define MAX_DRAM_QUEUE 64
+#define DRAM_NO_ROW 0xffffffffu
+
+struct DRAMRequest {
+    unsigned int bank, row;
+    unsigned long long arrival;      // cycle it entered the queue
+    unsigned long long id;           // in arrival order
+    int isWrite;
+};
+
+struct DRAMBank {
+    unsigned int openRow;            // DRAM_NO_ROW when precharged
+    unsigned long long readyAt;      // cycle the bank takes its next command
+};
+
+struct DRAMChannel {
+    struct DRAMBank bank[MAX_DRAM_BANKS];
+    struct DRAMRequest queue[MAX_DRAM_QUEUE];
+    int count;
+    unsigned long long clock;        // cycle the scheduler makes its next decision, at the earliest
+    unsigned long long busFree;      // cycle the data bus is free
+    unsigned long long busyCycles;   // cycles the data bus carried data
+};
+
+struct DRAM {
+    int enabled;
+    int channels, banks, rowBytes;
+    int closedPage;
+    int tRCD, tCL, tRP, tBurst;
+    int queueDepth;                  // requests per channel queue
+    int blockBytes;                  // of the cache in front, one block per request
+    struct DRAMChannel channel[MAX_DRAM_CHANNELS];
+    unsigned long long nextId;
+    unsigned long long reads, writes, rowHits, rowEmpty, rowConflicts;
+    unsigned long long readCycles;   // sum of the read latencies, from the queue to the last data
+    unsigned long long lastDone;     // cycle the last data left the bus
+};
+
+/**
+ * Miss status holding registers, the timing side of a non-blocking data cache (cpusim_cachesim --timing 1).
+ * The cache is still updated at the access, the MSHRs only decide when its data is there. A miss whose block
+ * has no MSHR allocates one until the block arrives, latency cycles later (a primary miss); an access to a
+ * block with an MSHR outstanding gets its data when that MSHR completes (a secondary miss, merged into it);
+ * every other access is served at once, whatever is outstanding (hit under miss, miss under miss). When all
+ * the MSHRs are busy a miss waits for the first one to complete. With no MSHRs the cache is blocking, a miss
+ * holds the core until its block arrives. Memory-level parallelism (MLP) is the average number of misses
+ * outstanding over the cycles with at least one outstanding.
+ */
+#define MAX_MSHRS 64
+
+struct MSHR {
+    unsigned int block;
+    unsigned long long readyAt;      // cycle the block arrives
+};
+
+struct MSHRFile {
+    int numEntries;                  // 0 for a blocking cache
+    int latency;                     // cycles from a miss to its block arriving, without a DRAM model
+    struct DRAM *dram;               // NULL unless the misses are timed by the DRAM model
+    struct MSHR entry[MAX_MSHRS];
+    int count;                       // outstanding
+    unsigned long long primary, secondary, hitsUnderMiss, missesUnderMiss;
+    unsigned long long fullStalls;   // cycles misses waited for a free MSHR
+    unsigned long long missCycles;   // sum of the latencies of the primary misses
+    unsigned long long busyCycles;   // cycles with at least one miss outstanding
+    unsigned long long busyUntil;
+};
+
+/**
+ * Address translation of the data accesses (cpusim_cachesim --mmu 1). The program runs as one process whose
+ * page table is shared by its cores, as threads; each core has its own TLBs. The page table has two levels
+ * like 32-bit x86: the top 10 bits of an address index the directory, the next 10 a page table of 4 KB pages.
+ * With --huge-pages 1 the directory entries map 4 MB pages themselves and a walk stops there. An access looks
+ * in the L1 TLB, then in the L2 TLB (l2Latency cycles), then walks the page table (walkLatency cycles per
+ * level read) and fills both TLBs. The whole data memory is mapped when the run starts, frame for page, so
+ * the caches see the same addresses with and without the MMU: what changes is the cost of translating them.
+ */
+#define PAGE_SHIFT 12
+#define HUGE_PAGE_SHIFT 22
+#define PT_ENTRIES 1024
+#define PTE_PRESENT 0x1
+#define PTE_HUGE 0x80                // a directory entry mapping a 4 MB page
+#define MAX_TLB_WAYS 16
+
+struct PageTable {
+    unsigned int directory[PT_ENTRIES];  // frame address | PTE_* of a huge page, or PTE_PRESENT for a table
+    unsigned int *table[PT_ENTRIES];     // [PT_ENTRIES] frame address | PTE_*, NULL for a huge page
+    int numTables;
+};
+
+struct TLB {
+    int numEntries, numWays, numSets;    // no TLB when numEntries is 0
+    unsigned int *page;                  // [numSets][numWays] virtual page number + 1, 0 when empty
+    unsigned int *frame;                 // [numSets][numWays] frame address
+    unsigned long long *lastUse;         // [numSets][numWays] LRU time stamps
+    unsigned long long useClock;
+};
+
+struct MMU {
+    int enabled;
+    int hugePages;
+    int l2Latency;                       // cycles of an L2 TLB hit
+    int walkLatency;                     // cycles per page table level read
+    struct TLB l1, l2;
+    struct PageTable *pageTable;
+    unsigned long long accesses, l1Hits, l2Hits, walks, walkCycles, faults;
+};
+
+/* how a demand access was served */
+#define CACHE_HIT 0
+#define CACHE_STREAM_HIT 1           // missed in the cache, served in time by a stream buffer
+#define CACHE_VICTIM_HIT 2           // missed in the cache, swapped back in from the victim cache
+#define CACHE_MISS 3                 // fetched from memory
+/* the outcomes the hit counters, the trace and the miss classification count as hits */
+#define CacheIsHit(outcome) ((outcome) == CACHE_HIT || (outcome) == CACHE_STREAM_HIT)
+
+extern struct Cache InstructionCache, DataCache;
+extern struct Prefetcher IPrefetch, DPrefetch;
+extern struct MissClassifier IMissClass, DMissClass;
+extern struct VictimCache IVictim, DVictim;
+extern struct CoherenceBus Bus;
+extern struct MSHRFile DMSHR;
+extern struct DRAM Dram;
+extern struct MMU DMMU;
+extern struct PageTable ProcessPageTable;
+
+/* the private caches of one more core: copies of InstructionCache and DataCache, with their own attachments */
+struct CoreCaches {
+    struct Cache icache, dcache;
+    struct Prefetcher iprefetch, dprefetch;
+    struct MissClassifier imissClass, dmissClass;
+    struct VictimCache ivictim, dvictim;
+    struct MSHRFile dmshr;
+    struct MMU dmmu;
+};
+
+void initCache(struct Cache *c, char *memory, unsigned long long memoryBytes);
+int setCacheGeometry(struct Cache *c, const char *value);
+unsigned long long cacheUnusedPrefetches(struct Cache *c);
+void prefetchFinish(struct Prefetcher *p, unsigned long long unusedInCache);
+void printPrefetchSummary(FILE *file, struct Prefetcher *p);
+int setPrefetchKind(struct Prefetcher *p, const char *value);
+void initMissClassifier(struct MissClassifier *c, struct Cache *cache);
+void printMissClassSummary(FILE *file, const char *cacheName, struct MissClassifier *c);
+void printVictimSummary(FILE *file, const char *cacheName, struct VictimCache *v);
+unsigned long long mshrAccess(struct MSHRFile *m, unsigned int block, int miss, unsigned long long *now);
+void printMSHRSummary(FILE *file, const char *cacheName, struct MSHRFile *m);
+int setDRAMOption(const char *key, const char *value);
+void printDRAMOptions();
+int initDRAM(struct DRAM *d, int blockBytes);
+unsigned long long dramRead(struct DRAM *d, unsigned int block, unsigned long long now);
+void dramWrite(struct DRAM *d, unsigned int block, unsigned long long *now);
+void dramFinish(struct DRAM *d);
+void printDRAMSummary(FILE *file, struct DRAM *d);
+int setMMUOption(const char *key, const char *value);
+void printMMUOptions();
+void initMMU(struct MMU *m, unsigned long long memoryBytes);
+unsigned int mmuTranslate(struct MMU *m, unsigned int addr, unsigned int *physical);
+void printMMUSummary(FILE *file, struct MMU *m);
+unsigned int *cacheAccess(struct Cache *c, unsigned int addr, unsigned int pc, int isWrite, int *outcome);
+void attachToBus(struct Cache *c);
+void coherenceReplay();
+void printCoherenceSummary(FILE *file);
+
+int setCacheOption(const char *key, const char *value);
+void printCacheOptions();
+void initCaches(char *instructionMemory, unsigned long long instructionBytes, char *dataMemory, unsigned long long dataBytes);
+void finishCaches();
+void initCoreCaches(struct CoreCaches *cc);
+void finishCoreCaches(struct CoreCaches *cc);
+void printCacheSummary(FILE *file);
+
+#endif
@@ -0,0 +1,125 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "cachemodel.h"
+#include "cputrace.h"
+
+/*
+ * Trace-driven cache simulator. Replays the instruction fetches and data accesses recorded by
+ * cpusim_cachesim --trace-out through the same cache model (cachemodel.c) that FetchInstructionWord,
+ * ReadDataWord and WriteDataWord use, without executing the program again. A cache study records the
+ * trace once and replays it for every cache configuration; all the cache options of the simulator
+ * (--icache, --dcache, --dprefetch, --dvictim, ...) are accepted and the summary lines are the same.
+ *
+ * Build:   the cachesim target of the CMake build
+ * Example: build/cpusim_cachesim bench/conv3.asm.bin --n 262144 --reg 4=262144 --trace 0 --trace-out conv3.ctr
+ *          build/cachesim conv3.ctr --dcache 256:4:32 --dprefetch stride
+ */
+
+/* the memories behind the caches of cpusim_cachesim, prefetches never go past their end. The contents do not
+ * matter for a replay, the pages of the data memory are never written so they are never really allocated. */
+#define INSTRUCTION_MEMORY_SIZE (1024*1024)
+#define DATA_MEMORY_SIZE (1024*1024*1024)
+
+unsigned long long NumInstructions = 0;
+unsigned long long NumICacheHit = 0;
+unsigned long long NumDCacheRead = 0;
+unsigned long long NumDCacheReadHit = 0;
+unsigned long long NumDCacheWrite = 0;
+unsigned long long NumDCacheWriteHit = 0;
+unsigned long long NumMismatches = 0;   // accesses whose outcome differs from the one recorded in the trace
+
+/**
+ * Replay the whole trace.
+ * @param check compare every outcome with the one recorded, they are the same when the cache options are
+ */
+void replay(struct CTraceReader *reader, int check) {
+    struct CTraceRecord r;
+    int a, outcome;
+    while (ctraceNext(reader, &r)) {
+        NumInstructions++;
+        cacheAccess(&InstructionCache, r.pc, r.pc, 0, &outcome);
+        NumICacheHit += CacheIsHit(outcome);
+        if (check) NumMismatches += CacheIsHit(outcome) == ((r.flags & CTR_IMISS) != 0);
+        for (a = 0; a < r.numAccesses; a++) {
+            cacheAccess(&DataCache, r.access[a].addr, r.pc, r.access[a].kind & CTR_ACCESS_WRITE, &outcome);
+            if (r.access[a].kind & CTR_ACCESS_WRITE) {
+                NumDCacheWrite++;
+                NumDCacheWriteHit += CacheIsHit(outcome);
+            } else {
+                NumDCacheRead++;
+                NumDCacheReadHit += CacheIsHit(outcome);
+            }
+            if (check) NumMismatches += CacheIsHit(outcome) == ((r.access[a].kind & CTR_ACCESS_MISS) != 0);
+        }
+    }
+}
+
+void usage() {
+    printf("Usage: cachesim <trace file> [options]\n"
+           "  --check <0|1>       compare the outcomes with the ones recorded in the trace, for a run with the same\n"
+           "                      cache options as the recording (default 0)\n");
+    printCacheOptions();
+}
+
+int main(int argc, char *argv[]) {
+    int check = 0;
+    if (argc < 2 || argv[1][0] == '-') {
+        usage();
+        return 1;
+    }
+    int arg;
+    for (arg = 2; arg < argc; arg++) {
+        if (strncmp(argv[arg], "--", 2) != 0 || arg + 1 == argc) {
+            usage();
+            return 1;
+        }
+        const char *key = argv[arg] + 2;
+        const char *value = argv[++arg];
+        int ok;
+        if (strcmp(key, "check") == 0) {
+            char *end;
+            check = (int)strtol(value, &end, 0);
+            ok = end != value && *end == '\0';
+        } else {
+            ok = setCacheOption(key, value) > 0;
+        }
+        if (!ok) {
+            printf("Invalid option --%s %s\n", key, value);
+            usage();
+            return 1;
+        }
+    }
+
+    struct CTraceReader *reader = ctraceOpen(argv[1], 1);
+    if (reader == NULL) {
+        printf("Could not read trace file %s\n", argv[1]);
+        return 1;
+    }
+    char *instructionMemory = (char*) calloc(INSTRUCTION_MEMORY_SIZE, 1);
+    char *dataMemory = (char*) calloc(DATA_MEMORY_SIZE, 1);
+    initCaches(instructionMemory, INSTRUCTION_MEMORY_SIZE, dataMemory, DATA_MEMORY_SIZE);
+
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    replay(reader, check);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    double seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec)*1e-9;
+    finishCaches();
+    ctraceCloseReader(reader);
+
+    unsigned long long accesses = NumInstructions + NumDCacheRead + NumDCacheWrite;
+    printf("Cache Simulation Summary: \n");
+    printf("\t Num of Instructions Executed: %llu, %llu Instructions Hit in Cache, Hit Ratio: %.2f\n",
+           NumInstructions, NumICacheHit, ((float)NumICacheHit)/((float)NumInstructions));
+    printf("\t LW Instruction Executed (MEM Read): %llu, DataCacheReadHit: %llu, Hit Ratio: %.2f\n",
+           NumDCacheRead, NumDCacheReadHit, ((float)NumDCacheReadHit)/((float)NumDCacheRead));
+    printf("\t SW Instruction Executed (MEM Write): %llu, DataCacheWriteHit: %llu, Hit Ratio: %.2f\n",
+           NumDCacheWrite, NumDCacheWriteHit, ((float)NumDCacheWriteHit)/((float)NumDCacheWrite));
+    printCacheSummary(stdout);
+    if (check) printf("Outcomes different from the trace: %llu\n", NumMismatches);
+    printf("Replayed %llu instructions, %llu cache accesses in %.6f seconds, %.2f M accesses/s\n",
+           NumInstructions, accesses, seconds, seconds > 0 ? accesses/seconds/1e6 : 0.0);
+    return check && NumMismatches != 0;
+}
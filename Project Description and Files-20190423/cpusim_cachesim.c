@@ -2,17 +2,53 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 #include <time.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <pthread.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "cachemodel.h"
+#include "cputrace.h"
 
 /* function opcode */
 #define ADD 0
 #define SUB 1
 #define LWR 2
+#define MUL 3
+#define AND 4
 #define ADDI 5
+#define OR  6
+#define XOR 7
 #define LW  8
 #define SW  9
+#define SLT 10
+#define SWR 11
 #define BEQ 12
+#define BNE 13
 #define J   15
+#define SLL 16
+#define SRL 17
+#define VLW 20
+#define VSW 21
+#define VADD 22
+
+/* the vector extension: 8 vector registers ($v0-$v7) of VECTOR_WORDS 32-bit words */
+#define NUM_VECTOR_REGISTERS 8
+#define VECTOR_WORDS 4
+
+/* the state of the core being simulated: with --parallel each core runs on its own host thread, which has
+ * its own copy of these */
+#define CORE_LOCAL __thread
 
 /**
  * handy for print the function string
@@ -27,16 +63,40 @@ char * funcName(int Func) {
             return "SUB";
         case LWR:
             return "LWR";
+        case MUL:
+            return "MUL";
+        case AND:
+            return "AND";
         case ADDI:
             return "ADDI";
+        case OR:
+            return "OR";
+        case XOR:
+            return "XOR";
         case LW:
             return "LW";
         case SW:
             return "SW";
+        case SLT:
+            return "SLT";
+        case SWR:
+            return "SWR";
         case BEQ:
             return "BEQ";
+        case BNE:
+            return "BNE";
         case J:
             return "J";
+        case SLL:
+            return "SLL";
+        case SRL:
+            return "SRL";
+        case VLW:
+            return "VLW";
+        case VSW:
+            return "VSW";
+        case VADD:
+            return "VADD";
     }
     return "";
 }
@@ -67,7 +127,7 @@ union InstructionWord {
 /**
  * All the data path of the CPU
  */
-struct datapath_t {
+CORE_LOCAL struct datapath_t {
     //data path for the IF stage
     unsigned int PC;                 // Program counter
     int JTImm;                       // Jump target
@@ -87,6 +147,7 @@ struct datapath_t {
     unsigned int RSvalue;            // The value of RSselect register, fed to ALUin1
     unsigned int RTvalue;            // The value of RTselect register, fed to either ALUin2 for ADD, SUB, and BEQ
                                      // or to memory as data to be written to for SW
+    unsigned int RDvalue;            // The value of RDselect register, the data written to memory by SWR
 
     //datapath for the EXE stage
     // no need ALUin1 since it is the same as RSvalue
@@ -94,20 +155,28 @@ struct datapath_t {
     unsigned int ALUout;             // ALU output, used for both R and I type instructions.
 
     //datapath for MEM stage
-    unsigned int MEMout;             // Only for LW
+    unsigned int MEMin;              // Data to be written to memory, selected from RTvalue (SW) or RDvalue (SWR)
+    unsigned int MEMout;             // Only for LW and LWR
     //datapath for the Address is the same as ALUout
 
     //datapath for WB stage
     unsigned int RWvalue;            // For writing data back to the register for ADD, SUB, ADDI, and LW
+
+    //datapath of the vector unit, the vector registers are selected by RSselect, RTselect and RWselect
+    int VSvalue[VECTOR_WORDS];       // The value of vector register RSselect (VADD)
+    int VTvalue[VECTOR_WORDS];       // The value of vector register RTselect (VADD, and the data of VSW)
+    int VALUout[VECTOR_WORDS];       // Vector ALU output (VADD)
+    int VMEMout[VECTOR_WORDS];       // Only for VLW
 } datapath;
 
 /**
  * All the control signal of the CPU
  */
-struct control_t {
+CORE_LOCAL struct control_t {
     unsigned int RegDst:1;
     unsigned int Jump:1;
     unsigned int Branch:1;
+    unsigned int BranchNotEqual:1;   // with Branch, take the branch when the ALU result is not zero (BNE)
     unsigned int MemRead:1;
     unsigned int MemtoReg:1;
     unsigned int ALUOp:6;
@@ -115,49 +184,46 @@ struct control_t {
     unsigned int ALUSrc:1;
     unsigned int RegWrite:1;
     unsigned int Zero:1;
+    unsigned int VectorOp:1;         // the instruction reads/writes the vector registers and moves VECTOR_WORDS words
+    unsigned int VRegWrite:1;        // write the result to vector register RWselect
 } control;
 
 /* The major CPU components, mainly the IM, DM, PC, and registers. mux is implemented as a simple c function*/
 char *InstructionMemory;
 char *DataMemory;
-int* RegisterFile;
-int PC; /* program counter register */
-int IR; /* instruction register */
-
-//This struct is used to decompose a 32-bit memory address into sections for ICache
-//The tiny ICache has 4 2-word blocks
-struct AddressToICacheAccess {
-    unsigned int ByteOffsetWithinWord:2;  //2 bit for byte offset within a word since a word has 4 byte
-    unsigned int WordOffsetWithinBlock:1; //1 bit for word offset within a block since a block has 2 words
-    unsigned int BlockIndex:2;            //2 bits for block index since ICache has 4 blocks
-    unsigned int tag:27;                  //The rest 27 bites are for tags of a cache line
-};
+CORE_LOCAL int* RegisterFile;
+CORE_LOCAL int (*VectorRegisterFile)[VECTOR_WORDS];  // NUM_VECTOR_REGISTERS rows, of the core being simulated
+CORE_LOCAL int PC; /* program counter register */
+CORE_LOCAL int IR; /* instruction register */
 
-struct InstructionCacheEntry {
-    unsigned int valid:1; // the valid bit
-    unsigned int tag:27;  // the tag field
-    unsigned int block[2]; //2-word block
-} InstructionCache[4]; // 4 2-word block and block index are 0,1,2,3
-int NumICacheHit = 0;
-
-//This struct is used to decompose a 32-bit memory address into sections for DCache
-//The DCache has 64 4-word blocks
-struct AddressToDCacheAccess {
-    unsigned int ByteOffsetWithinWord:2;  //2 bit for byte offset within a word since a word has 4 byte
-    unsigned int WordOffsetWithinBlock:2; //2 bit for word offset within a block since a block has 4 words
-    unsigned int BlockIndex:6;            //6 bits for block index since DCache has 64 blocks
-    unsigned int tag:22;                  //The rest 22 bites are for tags of a cache line
+/* the instruction and data caches of the core being simulated */
+CORE_LOCAL struct Cache *ICache = &InstructionCache;
+CORE_LOCAL struct Cache *DCache = &DataCache;
+
+CORE_LOCAL int NumICacheHit = 0;
+CORE_LOCAL int NumICacheMiss = 0;
+CORE_LOCAL int NumDCacheRead = 0;
+CORE_LOCAL int NumDCacheReadHit = 0;
+CORE_LOCAL int NumDCacheWrite = 0;
+CORE_LOCAL int NumDCacheWriteHit = 0;
+CORE_LOCAL int NumDCacheMiss = 0;   // read and write misses, each one brings a block in from DataMemory
+
+/*
+ * Timing model (--timing 1). The core issues one instruction per cycle, in order. An instruction waits at
+ * issue until the registers it names are ready, a scoreboard that covers the destination too so an
+ * outstanding load is never overtaken; an instruction cache miss holds the fetch for the memory latency; the
+ * data cache is non-blocking (struct MSHRFile in cachemodel.h): a load marks the cycle its destination
+ * register is ready and the core goes on until an instruction names it. A store only waits for a free MSHR.
+ */
+struct CoreTiming {
+    unsigned long long cycle;        // the instruction being executed issued at this cycle
+    unsigned long long regReady[32]; // cycle each register is written by an outstanding load
+    unsigned long long vregReady[NUM_VECTOR_REGISTERS];
+    unsigned long long dataReady;    // cycle the data accessed by the instruction being executed is there
+    unsigned long long fetchStalls, loadUseStalls, missStalls, tlbStalls;
 };
 
-struct DataCacheEntry {
-    unsigned int valid:1; // the valid bit
-    unsigned int tag:22;  // the tag field
-    unsigned int block[4]; //4-word block
-} DataCache[64]; // 4 2-word block and block index are 0,1,2,3
-int NumDCacheRead = 0;
-int NumDCacheReadHit = 0;
-int NumDCacheWrite = 0;
-int NumDCacheWriteHit = 0;
+CORE_LOCAL struct CoreTiming *Timing = NULL;   // of the core being simulated, NULL unless --timing 1
 
 /**
  * mux
@@ -169,35 +235,383 @@ int mux(int input0, int input1, char select) {
 
 //The trace file
 FILE *cpusimTraceFile;
+/* --trace 0 drops the per-instruction lines (the bulk of the run time of long runs), the verification
+ * result and the summary are still written */
+int TraceEnabled = 1;
+int TraceWriterRunning = 0;
+void traceDeferred(const char *format, ...);
+#define TRACE(...) do { \
+    if (TraceEnabled) { \
+        if (TraceWriterRunning) traceDeferred(__VA_ARGS__); else fprintf(cpusimTraceFile, __VA_ARGS__); \
+    } \
+} while (0)
+
+/*
+ * Asynchronous trace writer (--trace-async 1, the default when tracing). Formatting the trace costs far more
+ * than simulating, so the simulation thread does not format it: TRACE() only copies the format string
+ * pointer and the arguments into a record of a single-producer/single-consumer ring, and a writer thread
+ * formats the records and writes them to cpusimTraceFile in large blocks. The output is byte for byte the
+ * same as with fprintf. The format strings and the %s arguments must be string literals (they are read
+ * later, by the writer thread); %d, %u, %x and %c with the - and 0 flags and a width, their l and ll forms
+ * and %s are supported, anything else is formatted on the spot by vsnprintf.
+ */
+#define TRACE_RING_RECORDS 65536          // a power of 2
+#define MAX_TRACE_ARGS 8
+#define TRACE_OUT_BYTES (1 << 20)
+#define TRACE_OUT_SLACK 4096               // more than one formatted record, whose %s are short literals
+
+union TraceArg {
+    long long i;
+    const char *s;
+};
+
+struct TraceRecord {
+    const char *format;
+    int ownsString;                       // args[0].s was malloc'ed by traceDeferred() and is freed after use
+    union TraceArg args[MAX_TRACE_ARGS];
+};
+
+struct TraceRing {
+    struct TraceRecord *records;
+    unsigned long head;                   // next record the simulation thread fills, only it writes head
+    unsigned long tail;                   // next record the writer formats, only the writer writes tail
+    int closed;                           // no more records will come
+    pthread_t writer;
+} TraceRing;
+
+/*
+ * A format string compiled once: the literal text around each conversion and how to print the argument.
+ * Each thread keeps its own small cache of them, indexed by the address of the format string.
+ */
+#define TRACE_FORMAT_CACHE 512
+#define ARG_INT 0
+#define ARG_LONG 1
+#define ARG_LONG_LONG 2
+#define ARG_STRING 3
+
+struct TraceConversion {
+    unsigned char kind;                   // ARG_INT, ARG_LONG, ARG_LONG_LONG or ARG_STRING
+    char conv;                            // d, u, x, c or s
+    char leftAlign, zeroPad;
+    int width;
+};
+
+struct TraceFormat {
+    const char *format;                   // NULL for an empty cache entry
+    int numArgs;                          // -1 if the format has something traceDeferred() can't capture
+    const char *literal[MAX_TRACE_ARGS + 1];   // the text before conversion i, the last one is after them all
+    int literalLength[MAX_TRACE_ARGS + 1];
+    struct TraceConversion conversion[MAX_TRACE_ARGS];
+};
+
+struct TraceFormat ProducerFormats[TRACE_FORMAT_CACHE], WriterFormats[TRACE_FORMAT_CACHE];
+
+struct TraceFormat *compileTraceFormat(struct TraceFormat *cache, const char *format) {
+    struct TraceFormat *f = &cache[((unsigned long)format >> 3) & (TRACE_FORMAT_CACHE - 1)];
+    if (f->format == format) return f;
+    f->format = format;
+    f->numArgs = 0;
+    const char *p = format, *text = format;
+    while (*p) {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+        if (f->numArgs == MAX_TRACE_ARGS) {
+            f->numArgs = -1;
+            return f;
+        }
+        struct TraceConversion *c = &f->conversion[f->numArgs];
+        f->literal[f->numArgs] = text;
+        f->literalLength[f->numArgs] = (int)(p - text);
+        p++;
+        c->leftAlign = c->zeroPad = 0;
+        c->width = 0;
+        for (; *p == '-' || *p == '0'; p++) {
+            if (*p == '-') c->leftAlign = 1; else c->zeroPad = 1;
+        }
+        while (isdigit((unsigned char)*p)) c->width = c->width*10 + (*p++ - '0');
+        int longs = 0;
+        while (*p == 'l') {
+            longs++;
+            p++;
+        }
+        c->conv = *p;
+        if (c->conv == 's' && longs == 0) {
+            c->kind = ARG_STRING;
+        } else if ((c->conv == 'd' || c->conv == 'u' || c->conv == 'x' || c->conv == 'c') && longs <= 2) {
+            c->kind = longs == 0 ? ARG_INT : longs == 1 ? ARG_LONG : ARG_LONG_LONG;
+        } else {
+            f->numArgs = -1;              /* %%, precision, floats, ... */
+            return f;
+        }
+        p++;
+        text = p;
+        f->numArgs++;
+    }
+    f->literal[f->numArgs] = text;
+    f->literalLength[f->numArgs] = (int)(p - text);
+    return f;
+}
+
+/* the simulation thread side of TRACE() */
+void traceDeferred(const char *format, ...) {
+    va_list ap;
+    struct TraceRecord *record;
+    while (TraceRing.head - __atomic_load_n(&TraceRing.tail, __ATOMIC_ACQUIRE) == TRACE_RING_RECORDS) {
+        sched_yield(); /* full, the writer is behind */
+    }
+    record = &TraceRing.records[TraceRing.head & (TRACE_RING_RECORDS - 1)];
+    record->format = format;
+    record->ownsString = 0;
+
+    struct TraceFormat *f = compileTraceFormat(ProducerFormats, format);
+    if (f->numArgs >= 0) {
+        int a;
+        va_start(ap, format);
+        for (a = 0; a < f->numArgs; a++) {
+            switch (f->conversion[a].kind) {
+                case ARG_INT: record->args[a].i = va_arg(ap, int); break;
+                case ARG_LONG: record->args[a].i = va_arg(ap, long); break;
+                case ARG_LONG_LONG: record->args[a].i = va_arg(ap, long long); break;
+                default: record->args[a].s = va_arg(ap, const char *);
+            }
+        }
+        va_end(ap);
+    } else {
+        /* format it here, the writer gets the text */
+        va_start(ap, format);
+        int length = vsnprintf(NULL, 0, format, ap);
+        va_end(ap);
+        char *text = (char*) malloc(length + 1);
+        va_start(ap, format);
+        vsnprintf(text, length + 1, format, ap);
+        va_end(ap);
+        record->format = "%s";
+        record->args[0].s = text;
+        record->ownsString = 1;
+    }
+    __atomic_store_n(&TraceRing.head, TraceRing.head + 1, __ATOMIC_RELEASE);
+}
+
+/* append one formatted record to out, @return the number of bytes appended */
+int formatTraceRecord(char *out, const struct TraceRecord *record) {
+    const struct TraceFormat *f = compileTraceFormat(WriterFormats, record->format);
+    char *o = out;
+    int a;
+    for (a = 0; a < f->numArgs; a++) {
+        const struct TraceConversion *c = &f->conversion[a];
+        memcpy(o, f->literal[a], f->literalLength[a]);
+        o += f->literalLength[a];
+
+        char digits[24];
+        const char *text = digits;
+        int textLength, negative = 0;
+        if (c->kind == ARG_STRING) {
+            text = record->args[a].s;
+            textLength = (int)strlen(text);
+        } else if (c->conv == 'c') {
+            digits[0] = (char)record->args[a].i;
+            textLength = 1;
+        } else {
+            /* the value has the width of the argument, %x and %u print it unsigned */
+            unsigned long long v = (unsigned long long)record->args[a].i;
+            if (c->kind == ARG_INT && c->conv != 'd') v = (unsigned int)v;
+            if (c->kind == ARG_LONG && c->conv != 'd') v = (unsigned long)v;
+            if (c->conv == 'd' && record->args[a].i < 0) {
+                negative = 1;
+                v = 0 - v;
+            }
+            char *d = digits + sizeof(digits);
+            if (c->conv == 'x') {
+                do {
+                    *--d = "0123456789abcdef"[v & 15];
+                    v >>= 4;
+                } while (v);
+            } else {
+                do {
+                    *--d = (char)('0' + v % 10);
+                    v /= 10;
+                } while (v);
+            }
+            text = d;
+            textLength = (int)(digits + sizeof(digits) - d);
+        }
+        int pad = c->width - textLength - negative;
+        if (!c->leftAlign && !c->zeroPad) for (; pad > 0; pad--) *o++ = ' ';
+        if (negative) *o++ = '-';
+        if (!c->leftAlign && c->zeroPad) for (; pad > 0; pad--) *o++ = '0';
+        memcpy(o, text, textLength);
+        o += textLength;
+        if (c->leftAlign) for (; pad > 0; pad--) *o++ = ' ';
+    }
+    memcpy(o, f->literal[a], f->literalLength[a]);
+    return (int)(o - out) + f->literalLength[a];
+}
+
+/* the writer thread */
+void *traceWriterMain(void *unused) {
+    char *out = (char*) malloc(TRACE_OUT_BYTES);
+    size_t used = 0;
+    (void)unused;
+    for (;;) {
+        unsigned long head = __atomic_load_n(&TraceRing.head, __ATOMIC_ACQUIRE);
+        unsigned long tail = TraceRing.tail;
+        if (tail == head) {
+            if (__atomic_load_n(&TraceRing.closed, __ATOMIC_ACQUIRE)
+                && __atomic_load_n(&TraceRing.head, __ATOMIC_ACQUIRE) == tail) break;
+            if (used) {
+                fwrite(out, 1, used, cpusimTraceFile);
+                used = 0;
+            } else {
+                usleep(50);
+            }
+            continue;
+        }
+        for (; tail != head; tail++) {
+            struct TraceRecord *record = &TraceRing.records[tail & (TRACE_RING_RECORDS - 1)];
+            if (used > TRACE_OUT_BYTES - TRACE_OUT_SLACK || record->ownsString) {
+                fwrite(out, 1, used, cpusimTraceFile);
+                used = 0;
+            }
+            if (record->ownsString) {
+                fputs(record->args[0].s, cpusimTraceFile); /* formatted by traceDeferred(), any length */
+                free((void*)record->args[0].s);
+            } else {
+                used += formatTraceRecord(out + used, record);
+            }
+            /* hand the records back every so often, not one by one */
+            if ((tail & 255) == 255) __atomic_store_n(&TraceRing.tail, tail + 1, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&TraceRing.tail, tail, __ATOMIC_RELEASE);
+    }
+    if (used) fwrite(out, 1, used, cpusimTraceFile);
+    free(out);
+    return NULL;
+}
+
+void startTraceWriter() {
+    TraceRing.records = (struct TraceRecord*) malloc(TRACE_RING_RECORDS*sizeof(struct TraceRecord));
+    TraceRing.head = TraceRing.tail = 0;
+    TraceRing.closed = 0;
+    if (TraceRing.records == NULL || pthread_create(&TraceRing.writer, NULL, traceWriterMain, NULL) != 0) {
+        free(TraceRing.records);
+        return; /* stay synchronous */
+    }
+    TraceWriterRunning = 1;
+}
+
+/* drain the ring and stop the writer, what follows goes straight to cpusimTraceFile again */
+void stopTraceWriter() {
+    if (!TraceWriterRunning) return;
+    __atomic_store_n(&TraceRing.closed, 1, __ATOMIC_RELEASE);
+    pthread_join(TraceRing.writer, NULL);
+    free(TraceRing.records);
+    TraceWriterRunning = 0;
+}
 
 // fetch an instruction from ICache/I-Memory (instruction memory or instruction cache)
 // recall how to access cache
 // use address to icache struct to get the parts of the cache you need 
 int FetchInstructionWord(int addr) {
-    struct AddressToICacheAccess cacheAddress = *((struct AddressToICacheAccess*)&addr);
-    unsigned int blockIndex = cacheAddress.BlockIndex;
-    unsigned int tag = cacheAddress.tag;
-    unsigned int wordIndex = cacheAddress.WordOffsetWithinBlock;
-    //char buffer[33];
-    //int2bin(addr, buffer);
-    //printf("Instruction Address: %08x, %s\n", addr, buffer);
-    if (InstructionCache[blockIndex].valid && InstructionCache[blockIndex].tag == tag) {
-        //cache hit and fetch the word from cache
-        NumICacheHit++;
-        unsigned int instruction = InstructionCache[blockIndex].block[wordIndex];
-        fprintf(cpusimTraceFile, "Instruction Cache Hit %08x at PC %d, block %d\n", instruction, addr, blockIndex);
-        return instruction;
-    } else {//cache miss, fetch a block from memory, put in the cache and return the word requested
-        /* copy the block (2 words) from memory to cache line */
-        int blockAddressInMemory = addr & 0xFFFFFFF8;
-        memcpy((void*)InstructionCache[blockIndex].block, &InstructionMemory[blockAddressInMemory], 8);
-        InstructionCache[blockIndex].valid = 1;
-        InstructionCache[blockIndex].tag = tag;
-
-        unsigned int instruction = InstructionCache[blockIndex].block[wordIndex];
-        fprintf(cpusimTraceFile, "Instruction Cache Miss %08x at PC %d, block %d\n", instruction, addr, blockIndex);
-        return instruction;
+    int outcome;
+    unsigned int *block = cacheAccess(ICache, addr, addr, 0, &outcome);
+    unsigned int blockIndex = CacheSetOf(ICache, (unsigned int)addr >> ICache->blockShift);
+    unsigned int instruction = block[(addr & (ICache->blockBytes - 1)) >> 2];
+    switch (outcome) {
+        case CACHE_HIT:
+            //cache hit and fetch the word from cache
+            NumICacheHit++;
+            TRACE("Instruction Cache Hit %08x at PC %d, block %d\n", instruction, addr, blockIndex);
+            break;
+        case CACHE_STREAM_HIT:
+            //missed in the cache but the stream buffer had the block in time
+            NumICacheHit++;
+            TRACE("Instruction Stream Buffer Hit %08x at PC %d, block %d\n", instruction, addr, blockIndex);
+            break;
+        case CACHE_VICTIM_HIT:
+            //missed in the cache, the block was swapped back from the victim cache
+            NumICacheMiss++;
+            TRACE("Instruction Victim Cache Hit %08x at PC %d, block %d\n", instruction, addr, blockIndex);
+            break;
+        default:
+            //cache miss, the block was fetched from memory and put in the cache
+            NumICacheMiss++;
+            TRACE("Instruction Cache Miss %08x at PC %d, block %d\n", instruction, addr, blockIndex);
+    }
+    if (Timing != NULL && outcome == CACHE_MISS) {
+        Timing->cycle += DMSHR.latency;
+        Timing->fetchStalls += DMSHR.latency;
+    }
+    return instruction;
+}
+
+#define Later(a, b) ((a) > (b) ? (a) : (b))
+
+/**
+ * Hold the instruction just fetched until the registers it names are ready
+ */
+void issueInstruction() {
+    union InstructionWord iw = *(union InstructionWord *) &IR;
+    unsigned int rs = iw.rType.Rs, rt = iw.rType.Rt, rd = iw.rType.Rd;
+    const unsigned long long *r = Timing->regReady, *v = Timing->vregReady;
+    unsigned long long ready = 0;
+    switch (iw.iType.func) {
+        case ADD: case SUB: case LWR: case MUL: case AND: case OR: case XOR: case SLT: case SWR:
+            ready = Later(Later(r[rs], r[rt]), r[rd]);
+            break;
+        case ADDI: case LW: case SW: case BEQ: case BNE: case SLL: case SRL:
+            ready = Later(r[rs], r[rt]);
+            break;
+        case VLW: case VSW:
+            ready = Later(r[rs], v[rt % NUM_VECTOR_REGISTERS]);
+            break;
+        case VADD:
+            ready = Later(Later(v[rs % NUM_VECTOR_REGISTERS], v[rt % NUM_VECTOR_REGISTERS]), v[rd % NUM_VECTOR_REGISTERS]);
+            break;
+    }
+    if (ready > Timing->cycle) {
+        Timing->loadUseStalls += ready - Timing->cycle;
+        Timing->cycle = ready;
+    }
+    Timing->dataReady = 0;
+    TRACE("\tIssue at cycle %llu\n", Timing->cycle);
+}
+
+/**
+ * The instruction is done: a load sets when its destination register is ready, the next instruction can
+ * issue on the next cycle
+ */
+void retireInstruction() {
+    union InstructionWord iw = *(union InstructionWord *) &IR;
+    switch (iw.iType.func) {
+        case LW: Timing->regReady[iw.rType.Rt] = Timing->dataReady; break;
+        case LWR: Timing->regReady[iw.rType.Rd] = Timing->dataReady; break;
+        case VLW: Timing->vregReady[iw.rType.Rt % NUM_VECTOR_REGISTERS] = Timing->dataReady; break;
+    }
+    Timing->regReady[0] = 0;
+    Timing->cycle++;
+}
+
+/* the physical address of a data access, a TLB miss holds the core up for the translation */
+static inline unsigned int translateData(unsigned int addr) {
+    unsigned int physical, cycles = mmuTranslate(DCache->mmu, addr, &physical);
+    if (Timing != NULL) {
+        Timing->cycle += cycles;
+        Timing->tlbStalls += cycles;
     }
+    if (cycles) TRACE("\tData TLB miss at address %u, %u cycles\n", addr, cycles);
+    return physical;
+}
+
+/* when the data of a data cache access is there, the access may have to wait for an MSHR first, and a store for
+ * room in the DRAM queue its write through goes to */
+static inline void timeDataAccess(unsigned int addr, int outcome, int isWrite) {
+    unsigned long long issued = Timing->cycle;
+    unsigned long long ready = mshrAccess(DCache->mshr, addr >> DCache->blockShift, outcome == CACHE_MISS, &Timing->cycle);
+    if (isWrite && DCache->mshr->dram != NULL) dramWrite(DCache->mshr->dram, addr >> DCache->blockShift, &Timing->cycle);
+    Timing->missStalls += Timing->cycle - issued;
+    if (ready > Timing->dataReady) Timing->dataReady = ready;
 }
 
 /**
@@ -206,8 +620,9 @@ int FetchInstructionWord(int addr) {
 void fetch() {
     datapath.PC = PC;
     IR = FetchInstructionWord(PC);
-    fprintf(cpusimTraceFile, "\tFetch instruction %08x at PC %d\n", IR, PC);
+    TRACE("\tFetch instruction %08x at PC %d\n", IR, PC);
     datapath.PCplus4 = datapath.PC + 4; /* we use + to simulate the adder for adding PC and 4 */
+    if (Timing != NULL) issueInstruction();
 }
 
 /**
@@ -224,23 +639,23 @@ void decode()  {
     datapath.RDselect = instrWord.rType.Rd;
     datapath.Imm = instrWord.iType.Imm; /* automatically do sign extension */
     datapath.JTImm = instrWord.jType.Imm;
-    fprintf(cpusimTraceFile, "\tDecode instruction (fun rs rt rd Imm JTImm): %s %d %d %d %d %d\n",
+    TRACE("\tDecode instruction (fun rs rt rd Imm JTImm): %s %d %d %d %d %d\n",
            funcName(datapath.Func), datapath.RSselect, datapath.RTselect, datapath.RDselect, datapath.Imm, datapath.JTImm);
 }
 
-/*
- * 1. Set each of the control signal according to the func code of the instruction
- * 2. Select RWselect based on the RegDst control
- * 3. Fetch data from register and put them on the data path, only for RS and RT register
- * 4. Select ALUin2 based on the control.ALUSrc
- * 5. Update the jump target (shift left by 2)
+/**
+ * Set each of the control signals according to the func code of the instruction. A func code that is not an
+ * instruction leaves them as they were.
  */
-void controlAndRegisterFetch() {
+void setControlSignals() {
   switch (datapath.Func) {
     case ADD: {
       control.RegDst = 1;         // Select Rd as destination register
       control.Jump = 0;           // Not a jump instruction
       control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
       control.MemRead = 0;        // Not memory read, to data memory
       control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
       control.ALUOp = ADD;        // the ALU operation needs to perform
@@ -254,6 +669,9 @@ void controlAndRegisterFetch() {
       control.RegDst = 1;         // Select Rd as destination register
       control.Jump = 0;           // Not a jump instruction
       control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
       control.MemRead = 0;        // Not memory read, to data memory
       control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
       control.ALUOp = SUB;        // the ALU operation needs to perform
@@ -263,10 +681,111 @@ void controlAndRegisterFetch() {
                                   // needs to write the result to the register
       break;
     }
+    case MUL:
+    case AND:
+    case OR:
+    case XOR:
+    case SLT: {
+      control.RegDst = 1;         // Select Rd as destination register
+      control.Jump = 0;           // Not a jump instruction
+      control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
+      control.MemRead = 0;        // Not memory read, to data memory
+      control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
+      control.ALUOp = datapath.Func; // the ALU performs the operation named by the func code
+      control.MemWrite = 0;       // Not memory write (SW)
+      control.ALUSrc = 0;         // for selecting RTvalue in Mux 4 (instead of Imm)
+      control.RegWrite = 1;       // A signal to register to indicate that the instruction
+                                  // needs to write the result to the register
+      break;
+    }
+    case SLL:
+    case SRL: {
+      control.RegDst = 0;         // Select Rt as destination register
+      control.Jump = 0;           // Not a jump instruction
+      control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
+      control.MemRead = 0;        // Not memory read, to data memory
+      control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
+      control.ALUOp = datapath.Func; // shift Rs by the amount in Imm
+      control.MemWrite = 0;       // Not memory write (SW)
+      control.ALUSrc = 1;         // for selecting Imm in Mux 4 (the shift amount)
+      control.RegWrite = 1;       // A signal to register to indicate that the instruction
+                                  // needs to write the result to the register
+      break;
+    }
+    case BNE: {
+      control.RegDst = 0;         // Select Rd as destination register
+      control.Jump = 0;           // Not a jump instruction
+      control.Branch = 1;         // A branch, to the AND
+      control.BranchNotEqual = 1;  // taken when Rs - Rt is not zero
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
+      control.MemRead = 0;        // Not memory read, to data memory
+      control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
+      control.ALUOp = SUB;        // the ALU operation needs to perform
+      control.MemWrite = 0;       // Not memory write (SW)
+      control.ALUSrc = 0;         // for selecting RTvalue in Mux 4 (instead of Imm)
+      control.RegWrite = 0;       // A signal to register to indicate that the instruction
+                                  // needs to write the result to the register
+      break;
+    }
+    case VLW: {
+      control.RegDst = 0;         // Select Rt as destination vector register
+      control.Jump = 0;           // Not a jump instruction
+      control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 1;        // Loads VECTOR_WORDS words
+      control.VRegWrite = 1;       // The loaded words go to a vector register
+      control.MemRead = 1;        // Memory read, to data memory
+      control.MemtoReg = 1;       // Memory data to the register, for Mux 5
+      control.ALUOp = ADD;        // the ALU computes the address Rs + Imm
+      control.MemWrite = 0;       // Not memory write (SW)
+      control.ALUSrc = 1;         // for selecting Imm in Mux 4
+      control.RegWrite = 0;       // No scalar register is written
+      break;
+    }
+    case VSW: {
+      control.RegDst = 0;         // No destination register
+      control.Jump = 0;           // Not a jump instruction
+      control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 1;        // Stores VECTOR_WORDS words from vector register Rt
+      control.VRegWrite = 0;       // No vector register is written
+      control.MemRead = 0;        // Not memory read, to data memory
+      control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
+      control.ALUOp = ADD;        // the ALU computes the address Rs + Imm
+      control.MemWrite = 1;       // Memory write
+      control.ALUSrc = 1;         // for selecting Imm in Mux 4
+      control.RegWrite = 0;       // No scalar register is written
+      break;
+    }
+    case VADD: {
+      control.RegDst = 1;         // Select Rd as destination vector register
+      control.Jump = 0;           // Not a jump instruction
+      control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 1;        // Reads vector registers Rs and Rt
+      control.VRegWrite = 1;       // Writes vector register Rd
+      control.MemRead = 0;        // Not memory read, to data memory
+      control.MemtoReg = 0;       // The vector ALU result goes to the register, for Mux 5
+      control.ALUOp = VADD;       // element-wise add in the vector ALU
+      control.MemWrite = 0;       // Not memory write (SW)
+      control.ALUSrc = 0;         // for selecting the register operand in Mux 4
+      control.RegWrite = 0;       // No scalar register is written
+      break;
+    }
     case LW: {
       control.RegDst = 0;         // Select Rd as destination register
       control.Jump = 0;           // Not a jump instruction
       control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
       control.MemRead = 1;        // Not memory read, to data memory
       control.MemtoReg = 1;       // Not for LW data to memory, for Mux 5
       control.ALUOp = ADD;        // the ALU operation needs to perform
@@ -275,26 +794,46 @@ void controlAndRegisterFetch() {
       control.RegWrite = 1;       // A signal to register to indicate that the instruction
                                   // needs to write the result to the register
       break;
-    }/*
-      LOOK THIS UP
-      */
+    }
     case LWR: {
-      control.RegDst = 0;         // Select Rd as destination register
+      control.RegDst = 1;         // Select Rd as destination register, "lwr rd, rs, rt"
       control.Jump = 0;           // Not a jump instruction
       control.Branch = 0;         // Not a branch, to the AND
-      control.MemRead = 1;        // Not memory read, to data memory
-      control.MemtoReg = 1;       // Not for LW data to memory, for Mux 5
-      control.ALUOp = ADD;        // the ALU operation needs to perform
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
+      control.MemRead = 1;        // Memory read, to data memory
+      control.MemtoReg = 1;       // Memory data to the register, for Mux 5
+      control.ALUOp = ADD;        // the ALU computes the address Rs + Rt
       control.MemWrite = 0;       // Not memory write (SW)
-      control.ALUSrc = 1;         // for selecting RTvalue in Mux 4 (instead of Imm)
+      control.ALUSrc = 0;         // for selecting RTvalue in Mux 4, the index register
       control.RegWrite = 1;       // A signal to register to indicate that the instruction
                                   // needs to write the result to the register
       break;
     }
+    case SWR: {
+      control.RegDst = 1;         // Select RDvalue as the data to be written, "swr rd, rs, rt"
+      control.Jump = 0;           // Not a jump instruction
+      control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
+      control.MemRead = 0;        // Not memory read, to data memory
+      control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
+      control.ALUOp = ADD;        // the ALU computes the address Rs + Rt
+      control.MemWrite = 1;       // Memory write
+      control.ALUSrc = 0;         // for selecting RTvalue in Mux 4, the index register
+      control.RegWrite = 0;       // A signal to register to indicate that the instruction
+                                  // needs to write the result to the register
+      break;
+    }
     case SW: {
       control.RegDst = 0;         // Select Rd as destination register
       control.Jump = 0;           // Not a jump instruction
       control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
       control.MemRead = 0;        // Not memory read, to data memory
       control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
       control.ALUOp = ADD;        // the ALU operation needs to perform
@@ -308,6 +847,9 @@ void controlAndRegisterFetch() {
       control.RegDst = 0;         // Select Rd as destination register
       control.Jump = 0;           // Not a jump instruction
       control.Branch = 1;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
       control.MemRead = 0;        // Not memory read, to data memory
       control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
       control.ALUOp = SUB;        // the ALU operation needs to perform
@@ -321,6 +863,9 @@ void controlAndRegisterFetch() {
       control.RegDst = 0;         // Select Rd as destination register
       control.Jump = 0;           // Not a jump instruction
       control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
       control.MemRead = 0;        // Not memory read, to data memory
       control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
       control.ALUOp = ADD;        // the ALU operation needs to perform
@@ -334,6 +879,9 @@ void controlAndRegisterFetch() {
       control.RegDst = 0;         // Select Rd as destination register
       control.Jump = 1;           // Not a jump instruction
       control.Branch = 0;         // Not a branch, to the AND
+      control.BranchNotEqual = 0;  // Not a BNE
+      control.VectorOp = 0;        // Not a vector instruction
+      control.VRegWrite = 0;       // No vector register is written
       control.MemRead = 0;        // Not memory read, to data memory
       control.MemtoReg = 0;       // Not for LW data to memory, for Mux 5
       control.ALUOp = 0;        // the ALU operation needs to perform
@@ -344,33 +892,77 @@ void controlAndRegisterFetch() {
       break;
     }
   }
+}
+
+/*
+ * 1. Set each of the control signal according to the func code of the instruction
+ * 2. Select RWselect based on the RegDst control
+ * 3. Fetch data from register and put them on the data path, only for RS and RT register
+ * 4. Select ALUin2 based on the control.ALUSrc
+ * 5. Update the jump target (shift left by 2)
+ */
+void controlAndRegisterFetch() {
+  setControlSignals();
 
     /* TODO: setting datapath: RWselect, RSvalue, RTvalue, ALUin2 and JTImm */
   datapath.RWselect = mux(datapath.RTselect, datapath.RDselect, control.RegDst);
   datapath.RSvalue = RegisterFile[datapath.RSselect];
   datapath.RTvalue = RegisterFile[datapath.RTselect];
+  datapath.RDvalue = RegisterFile[datapath.RDselect];
   datapath.ALUin2 = mux(datapath.RTvalue, datapath.Imm, control.ALUSrc);
+  datapath.MEMin = mux(datapath.RTvalue, datapath.RDvalue, control.RegDst);
   datapath.JTImm = datapath.JTImm * 4;
+  if (control.VectorOp) {
+    memcpy(datapath.VSvalue, VectorRegisterFile[datapath.RSselect % NUM_VECTOR_REGISTERS], sizeof(datapath.VSvalue));
+    memcpy(datapath.VTvalue, VectorRegisterFile[datapath.RTselect % NUM_VECTOR_REGISTERS], sizeof(datapath.VTvalue));
+  }
 
 
     //write trace to file
-    fprintf(cpusimTraceFile, "\tFetch register: Rs: Reg[%d]=%d, Rt: Reg[%d]=%d\n",
+    TRACE("\tFetch register: Rs: Reg[%d]=%d, Rt: Reg[%d]=%d\n",
            datapath.RSselect, datapath.RSvalue, datapath.RTselect, datapath.RTvalue);
 }
 
 /**
- * 1. Select ALUin2 based on ALUSrc control
- * 2. Perform ALU operation on the input and ALUop, and update ALUout datapath
- * 3. Update the Zero control signal based on the output of ALU
- * 4. Update the BTaddr datapath
+ * The ALU: ALUout and the Zero control signal from RSvalue, ALUin2 and ALUOp
  */
-void EXE() {
-  //TODO: setting datapath: ALUin2, ALUout by doing either ADD or SUB depending on the ALUop control, and BTaddr
-  datapath.ALUin2 = mux(datapath.RTvalue, datapath.Imm, control.ALUSrc);
-  if (control.ALUOp == ADD) {
-    datapath.ALUout = datapath.RSvalue + datapath.ALUin2;
-  } else if (control.ALUOp == SUB){
-    datapath.ALUout = datapath.RSvalue - datapath.ALUin2;
+void ALU() {
+  switch (control.ALUOp) {
+    case ADD:
+      datapath.ALUout = datapath.RSvalue + datapath.ALUin2;
+      break;
+    case SUB:
+      datapath.ALUout = datapath.RSvalue - datapath.ALUin2;
+      break;
+    case MUL:
+      datapath.ALUout = datapath.RSvalue * datapath.ALUin2;  /* low 32 bits of the product */
+      break;
+    case AND:
+      datapath.ALUout = datapath.RSvalue & datapath.ALUin2;
+      break;
+    case OR:
+      datapath.ALUout = datapath.RSvalue | datapath.ALUin2;
+      break;
+    case XOR:
+      datapath.ALUout = datapath.RSvalue ^ datapath.ALUin2;
+      break;
+    case SLT:
+      datapath.ALUout = (int)datapath.RSvalue < (int)datapath.ALUin2;
+      break;
+    case SLL:
+      datapath.ALUout = datapath.RSvalue << (datapath.ALUin2 & 31);
+      break;
+    case SRL:
+      datapath.ALUout = datapath.RSvalue >> (datapath.ALUin2 & 31);  /* logical, RSvalue is unsigned */
+      break;
+    case VADD: {
+      int k;
+      for (k = 0; k < VECTOR_WORDS; k++) {
+        datapath.VALUout[k] = (int)((unsigned int)datapath.VSvalue[k] + (unsigned int)datapath.VTvalue[k]);
+      }
+      datapath.ALUout = 0;
+      break;
+    }
   }
   
   if (datapath.ALUout == 0) {
@@ -378,136 +970,2381 @@ void EXE() {
   } else {
     control.Zero = 0;
   }
-  datapath.BTaddr = datapath.PCplus4 + (datapath.Imm << 2);
+}
+
+/**
+ * 1. Select ALUin2 based on ALUSrc control
+ * 2. Perform ALU operation on the input and ALUop, and update ALUout datapath
+ * 3. Update the Zero control signal based on the output of ALU
+ * 4. Update the BTaddr datapath
+ */
+void EXE() {
+  datapath.ALUin2 = mux(datapath.RTvalue, datapath.Imm, control.ALUSrc);
+  ALU();
+  datapath.BTaddr = datapath.PCplus4 + datapath.Imm * 4;
   
   
-  fprintf(cpusimTraceFile, "\tEXE: Ops %s, ALUout: %d, Zero: %d, BTaddr: %d\n",
+  TRACE("\tEXE: Ops %s, ALUout: %d, Zero: %d, BTaddr: %d\n",
           funcName(control.ALUOp), datapath.ALUout, control.Zero, datapath.BTaddr);
 }
 
 #define ReadDataMemoryWord(addr)     *((int*)(&DataMemory[addr]))
 #define WriteDataMemoryWord(addr, word) *(int*)(&DataMemory[addr])=word
 
+/* --trace-out <file>: the compressed binary trace (cputrace.h), written next to and independent of the text trace */
+struct CTraceWriter *TraceOut = NULL;
+struct CTraceRecord TraceOutRecord;   // the record of the instruction being executed
+
+void traceOutAccess(unsigned int addr, int isWrite, int outcome) {
+    if (TraceOutRecord.numAccesses == CTR_MAX_ACCESSES) return;
+    struct CTraceAccess *a = &TraceOutRecord.access[TraceOutRecord.numAccesses++];
+    a->addr = addr;
+    a->kind = (isWrite ? CTR_ACCESS_WRITE : 0) | (CacheIsHit(outcome) ? 0 : CTR_ACCESS_MISS);
+}
+
+/*
+ * Store buffer of a core in a deterministic parallel run (--parallel 1 --deterministic 1). The stores of the
+ * core during an epoch are kept here instead of going to DataMemory, so the other cores read DataMemory as it
+ * was at the start of the epoch however the host schedules their threads. The core reads its own stores
+ * back from the buffer, its data cache may have refetched the block since. drainStoreBuffers() writes them
+ * to DataMemory at the end of the epoch.
+ */
+struct BufferedStore {
+    unsigned long long key;          // the busKey of the data cache when the store was made
+    unsigned int addr;
+    int value;
+};
+
+struct StoreBuffer {
+    struct BufferedStore *stores;    // in program order
+    int count, capacity;
+    int *slots;                      // [2*capacity] open addressing on the address: 1 + the last store to it, 0 is empty
+};
+
+CORE_LOCAL struct StoreBuffer *CoreStores = NULL;   // of the core being simulated, NULL unless stores are buffered
+
+static int *storeSlot(struct StoreBuffer *b, unsigned int addr) {
+    unsigned int mask = 2*b->capacity - 1, h;
+    for (h = (addr >> 2) * 0x9E3779B1u;; h++) {
+        int *slot = &b->slots[h & mask];
+        if (*slot == 0 || b->stores[*slot - 1].addr == addr) return slot;
+    }
+}
+
+void bufferStore(struct StoreBuffer *b, unsigned int addr, int value) {
+    int i;
+    if (b->count == b->capacity) {
+        b->capacity = b->capacity ? b->capacity*2 : 1024;
+        b->stores = (struct BufferedStore*) realloc(b->stores, b->capacity*sizeof(struct BufferedStore));
+        free(b->slots);
+        b->slots = (int*) calloc(2*b->capacity, sizeof(int));
+        for (i = 0; i < b->count; i++) *storeSlot(b, b->stores[i].addr) = i + 1;
+    }
+    b->stores[b->count].key = DCache->busKey;
+    b->stores[b->count].addr = addr;
+    b->stores[b->count].value = value;
+    *storeSlot(b, addr) = ++b->count;
+}
+
+/* the value of the last store to addr still in the buffer, if there is one */
+static inline void bufferedLoad(struct StoreBuffer *b, unsigned int addr, int *value) {
+    if (b->count == 0) return;
+    int slot = *storeSlot(b, addr);
+    if (slot) *value = b->stores[slot - 1].value;
+}
+
+/* write-through, one word */
+static inline void writeThrough(unsigned int addr, int word) {
+    if (CoreStores != NULL) bufferStore(CoreStores, addr, word);
+    else WriteDataMemoryWord(addr, word);
+}
+
 //read a word from cache|memory
 int ReadDataWord(int addr) {
-    //return ReadDataMemoryWord(addr); //TODO: Delete or comment out this line to use your implementation
-
-    //TODO: Implement the function of reading a word from a address. The function simulates the behavior
-    //of reading data from the DataCache/DataMemory memory hierarchy. Check FetchInstructionWord function for how to read an
-    //instruction word from ICache/InstructionMemory. This function should be very similar to FetchInstructionWord.
-  
-  struct AddressToICacheAccess cacheAddress = *((struct AddressToICacheAccess*)&addr);
-  unsigned int blockIndex = cacheAddress.BlockIndex;
-  unsigned int tag = cacheAddress.tag;
-  unsigned int wordIndex = cacheAddress.WordOffsetWithinBlock;
-  //char buffer[33];
-  //int2bin(addr, buffer);
-  //printf("Instruction Address: %08x, %s\n", addr, buffer);
-  if (InstructionCache[blockIndex].valid && InstructionCache[blockIndex].tag == tag) {
-    //cache hit and fetch the word from cache
-    NumICacheHit++;
-    unsigned int instruction = InstructionCache[blockIndex].block[wordIndex];
-    fprintf(cpusimTraceFile, "Instruction Cache Hit %08x at PC %d, block %d\n", instruction, addr, blockIndex);
-    return instruction;
-  } else {//cache miss, fetch a block from memory, put in the cache and return the word requested
-    /* copy the block (2 words) from memory to cache line */
-    int blockAddressInMemory = addr & 0xFFFFFFF8;
-    memcpy((void*)InstructionCache[blockIndex].block, &InstructionMemory[blockAddressInMemory], 8);
-    InstructionCache[blockIndex].valid = 1;
-    InstructionCache[blockIndex].tag = tag;
-    
-    unsigned int instruction = InstructionCache[blockIndex].block[wordIndex];
-    fprintf(cpusimTraceFile, "Instruction Cache Miss %08x at PC %d, block %d\n", instruction, addr, blockIndex);
-    return instruction;
-  }
-  
+    int outcome;
+    if (DCache->mmu != NULL) addr = (int)translateData((unsigned int)addr);
+    unsigned int *block = cacheAccess(DCache, addr, datapath.PC, 0, &outcome);
+    unsigned int blockIndex = CacheSetOf(DCache, (unsigned int)addr >> DCache->blockShift);
+    int word = block[(addr & (DCache->blockBytes - 1)) >> 2];
+    if (CoreStores != NULL) bufferedLoad(CoreStores, addr, &word);
+    if (Timing != NULL) timeDataAccess(addr, outcome, 0);
+    NumDCacheRead++;
+    if (TraceOut != NULL) traceOutAccess(addr, 0, outcome);
+    switch (outcome) {
+        case CACHE_HIT:
+            NumDCacheReadHit++;
+            TRACE("Data Cache Read Hit %08x at address %d, block %d\n", word, addr, blockIndex);
+            break;
+        case CACHE_STREAM_HIT:
+            NumDCacheReadHit++;
+            TRACE("Data Stream Buffer Read Hit %08x at address %d, block %d\n", word, addr, blockIndex);
+            break;
+        case CACHE_VICTIM_HIT:
+            NumDCacheMiss++;
+            TRACE("Data Victim Cache Read Hit %08x at address %d, block %d\n", word, addr, blockIndex);
+            break;
+        default:
+            NumDCacheMiss++;
+            TRACE("Data Cache Read Miss %08x at address %d, block %d\n", word, addr, blockIndex);
+    }
+    return word;
 }
 
 //write a word to cache|memory, write through is used and write-allocate if there is a miss
 void WriteDataWord(unsigned int addr, unsigned int word) {
-    WriteDataMemoryWord(addr, word); //TODO: Delete or comment out this line to use your implementation
-
-    //TODO: Implement the function of writing a word to a memory address. The function simulates the behavior
-    //of writing data to the DataCache/DataMemory hierarchy. It should be similar to FetchInstructionWord or
-    //ReadDataWord except that it writes data. Write-through policy is used, i.e. if there is a cache hit, the word
-    //in the cache block is updated and the block that contains the word should written to DataMemory.
-    //Write-allocate is used if there is a miss, i.e. the cache block should be first read from the DataMemory
-    //to the DataCache, then word is written to the cache block, and after that, the whole cache block
-    //is written to the DataMemory
+    int outcome;
+    if (DCache->mmu != NULL) addr = translateData(addr);
+    unsigned int *block = cacheAccess(DCache, addr, datapath.PC, 1, &outcome);
+    unsigned int blockIndex = CacheSetOf(DCache, addr >> DCache->blockShift);
+    if (Timing != NULL) timeDataAccess(addr, outcome, 1);
+    NumDCacheWrite++;
+    if (TraceOut != NULL) traceOutAccess(addr, 1, outcome);
+    switch (outcome) {
+        case CACHE_HIT:
+            NumDCacheWriteHit++;
+            TRACE("Data Cache Write Hit %08x at address %d, block %d\n", word, addr, blockIndex);
+            break;
+        case CACHE_STREAM_HIT:
+            NumDCacheWriteHit++;
+            TRACE("Data Stream Buffer Write Hit %08x at address %d, block %d\n", word, addr, blockIndex);
+            break;
+        case CACHE_VICTIM_HIT:
+            NumDCacheMiss++;
+            TRACE("Data Victim Cache Write Hit %08x at address %d, block %d\n", word, addr, blockIndex);
+            break;
+        default://write-allocate, the block was brought in first
+            NumDCacheMiss++;
+            TRACE("Data Cache Write Miss %08x at address %d, block %d\n", word, addr, blockIndex);
+    }
+    block[(addr & (DCache->blockBytes - 1)) >> 2] = word;
+    /* write-through of the word alone: with --parallel the rest of the block may be older than DataMemory */
+    writeThrough(addr, word);
 }
 
 /**
- * 1. Read or write memory depending on the MemRead and MemWrite control
- * 2. Resolve branch or jump and calculate PCnext.
+ * Read VECTOR_WORDS consecutive words starting at a word-aligned address. The words are gathered one cache
+ * block at a time: an access that stays within one DataCache block costs one cache access, an unaligned
+ * one that straddles two blocks costs two. Each block access counts as one data cache read.
  */
-void MEM() {
-  if (control.MemRead) {
-    //TODO: setting datapath: Memout if MemRead control is set. You should use ReadDataMemoryWord macro defined in front of this function
-    datapath.MEMout = ReadDataMemoryWord(datapath.ALUout);
-    
-    
-    fprintf(cpusimTraceFile, "\tMEM: LW from %d, value: %d\n", datapath.ALUout, datapath.MEMout);
-  } // for LW|LWR instruction
-  if (control.MemWrite) {
-    //TODO: perform memory write using the WriteDataMemoryWord macro defined in front of this function
-    WriteDataMemoryWord(datapath.ALUout, datapath.RTvalue);
-    
-    fprintf(cpusimTraceFile, "\tMEM: SW at %d, value: %d\n", datapath.ALUout, datapath.RTvalue);
-  } // for SW
-  
-  //TODO: setting datapath: PCplus4OrBTaddr and PCnext
-  
-  if(control.Branch == 1 && control.Zero == 1) {
-    datapath.PCplus4OrBTaddr = datapath.BTaddr;
-  } else {
-    datapath.PCplus4OrBTaddr = datapath.PCplus4;
-  }
-  
-  if(control.Jump == 1) {
-    datapath.PCnext = datapath.JTImm;
-    
-  } else {
-    datapath.PCnext = datapath.PCplus4OrBTaddr;
-    
-  }
-  
-  fprintf(cpusimTraceFile, "\tMEM: PCnext: %d\n", datapath.PCnext);
+void ReadDataVector(unsigned int addr, int *words) {
+    int k = 0;
+    while (k < VECTOR_WORDS) {
+        unsigned int wordAddr = addr + k*4;
+        if (DCache->mmu != NULL) wordAddr = translateData(wordAddr);
+        unsigned int blockAddr = wordAddr & ~(DCache->blockBytes - 1u);
+        unsigned int offset = (wordAddr & (DCache->blockBytes - 1)) >> 2;
+        int outcome;
+        unsigned int *block = cacheAccess(DCache, wordAddr, datapath.PC, 0, &outcome);
+        if (Timing != NULL) timeDataAccess(wordAddr, outcome, 0);
+        NumDCacheRead++;
+        if (TraceOut != NULL) traceOutAccess(wordAddr, 0, outcome);
+        if (CacheIsHit(outcome)) NumDCacheReadHit++; else NumDCacheMiss++;
+        TRACE("Data Cache Vector Read %s at address %d, block %d\n", CacheIsHit(outcome) ? "Hit" : "Miss",
+                wordAddr, CacheSetOf(DCache, wordAddr >> DCache->blockShift));
+        for (; k < VECTOR_WORDS && offset < (unsigned int)DCache->blockBytes/4; k++, offset++) {
+            words[k] = block[offset];
+            if (CoreStores != NULL) bufferedLoad(CoreStores, blockAddr + offset*4, &words[k]);
+        }
+    }
 }
+
 /**
- * 1. Select RWvalue
- * 2. Write to register file if RegWrite control is set
+ * Write VECTOR_WORDS consecutive words, one write-allocate, write-through cache block access per block touched
  */
-void WB() {
-  //TODO: setting datapath: RWvalue
-  if(control.MemtoReg == 1) {
+void WriteDataVector(unsigned int addr, const int *words) {
+    int k = 0;
+    while (k < VECTOR_WORDS) {
+        unsigned int wordAddr = addr + k*4;
+        if (DCache->mmu != NULL) wordAddr = translateData(wordAddr);
+        unsigned int blockAddr = wordAddr & ~(DCache->blockBytes - 1u);
+        unsigned int offset = (wordAddr & (DCache->blockBytes - 1)) >> 2;
+        int outcome;
+        unsigned int *block = cacheAccess(DCache, wordAddr, datapath.PC, 1, &outcome);
+        if (Timing != NULL) timeDataAccess(wordAddr, outcome, 1);
+        NumDCacheWrite++;
+        if (TraceOut != NULL) traceOutAccess(wordAddr, 1, outcome);
+        if (CacheIsHit(outcome)) NumDCacheWriteHit++; else NumDCacheMiss++;
+        TRACE("Data Cache Vector Write %s at address %d, block %d\n", CacheIsHit(outcome) ? "Hit" : "Miss",
+                wordAddr, CacheSetOf(DCache, wordAddr >> DCache->blockShift));
+        for (; k < VECTOR_WORDS && offset < (unsigned int)DCache->blockBytes/4; k++, offset++) {
+            block[offset] = words[k];
+            writeThrough(blockAddr + offset*4, words[k]);
+        }
+    }
+}
+
+/**
+ * Memory access pattern profiler. Every LW/SW address is fed to an online analyzer that keeps, per static
+ * load/store PC, the last address and stride and a log2 histogram of reuse distances, plus a hash table with
+ * the last access of every 16-byte block (the default DCache block size). Reuse distance is the number of memory
+ * accesses since the same block was last touched. The working set is the number of distinct blocks touched in
+ * each window of MemWindow accesses (--mem-window). Nothing is kept per dynamic access, so it runs on long
+ * programs. The report is written by writeMemoryProfileReport() at exit.
+ */
+#define MEM_BLOCK_SHIFT 4
+#define REUSE_BUCKETS 33               // bucket k counts distances in [2^(k-1), 2^k), bucket 0 is distance 0 (never used)
+
+struct AccessPattern {
+    unsigned long long loads;
+    unsigned long long stores;
+    unsigned int lastAddr;
+    int lastStride;
+    unsigned long long sameStride;     // accesses whose stride equals the previous stride
+    unsigned long long reused;         // accesses to a block touched before
+    unsigned long long reuseHist[REUSE_BUCKETS];
+} *MemPattern = NULL;
+int MemPatternSize = 0;
+
+struct BlockLastUse {
+    unsigned int block;                // block address + 1, 0 marks an empty slot
+    unsigned int window;               // last window the block was counted in
+    unsigned long long lastAccess;     // access number of the last access
+} *BlockTable = NULL;
+unsigned long long BlockTableMask = 0;
+unsigned long long BlockTableUsed = 0;
+
+unsigned long long NumMemAccesses = 0;
+long MemWindow = 1;
+unsigned long long ReuseHist[REUSE_BUCKETS];   // all PCs together
+unsigned long long ColdAccesses = 0;           // first touch of a block
+
+unsigned int *WindowBlocks = NULL;             // distinct blocks per window
+unsigned long long NumWindows = 0, WindowCapacity = 0;
+
+struct BlockLastUse *findBlock(unsigned int block) {
+    unsigned long long h = (block * 0x9E3779B97F4A7C15ULL) >> 17;
+    for (;; h++) {
+        struct BlockLastUse *slot = &BlockTable[h & BlockTableMask];
+        if (slot->block == block + 1 || slot->block == 0) return slot;
+    }
+}
+
+void growBlockTable() {
+    struct BlockLastUse *old = BlockTable;
+    unsigned long long oldSize = BlockTableMask + 1, i;
+    BlockTableMask = oldSize*2 - 1;
+    BlockTable = (struct BlockLastUse*) calloc(oldSize*2, sizeof(struct BlockLastUse));
+    for (i = 0; i < oldSize; i++) {
+        if (old[i].block) *findBlock(old[i].block - 1) = old[i];
+    }
+    free(old);
+}
+
+void initMemoryProfiler(int numInstr, long window) {
+    MemPatternSize = numInstr;
+    MemWindow = window;
+    MemPattern = (struct AccessPattern*) calloc(numInstr, sizeof(struct AccessPattern));
+    BlockTableMask = 4096 - 1;
+    BlockTable = (struct BlockLastUse*) calloc(BlockTableMask + 1, sizeof(struct BlockLastUse));
+}
+
+/**
+ * Called from MEM() for every data memory access
+ */
+void recordMemoryAccess(int pc, unsigned int addr, int isWrite) {
+    unsigned long long now = NumMemAccesses++;
+    unsigned int window = (unsigned int)(now / MemWindow);
+    if (window >= NumWindows) {
+        if (window >= WindowCapacity) {
+            WindowCapacity = WindowCapacity ? WindowCapacity*2 : 1024;
+            WindowBlocks = (unsigned int*) realloc(WindowBlocks, WindowCapacity*sizeof(unsigned int));
+        }
+        while (NumWindows <= window) WindowBlocks[NumWindows++] = 0;
+    }
+
+    struct BlockLastUse *slot = findBlock(addr >> MEM_BLOCK_SHIFT);
+    int bucket = -1;
+    if (slot->block == 0) {
+        if ((BlockTableUsed + 1)*2 > BlockTableMask + 1) {
+            growBlockTable();
+            slot = findBlock(addr >> MEM_BLOCK_SHIFT);
+        }
+        BlockTableUsed++;
+        slot->block = (addr >> MEM_BLOCK_SHIFT) + 1;
+        slot->window = window;
+        WindowBlocks[window]++;
+        ColdAccesses++;
+    } else {
+        unsigned long long distance = now - slot->lastAccess;
+        bucket = 64 - __builtin_clzll(distance);     /* distance >= 1, so bucket is 1..REUSE_BUCKETS-1 */
+        ReuseHist[bucket]++;
+        if (slot->window != window) {
+            slot->window = window;
+            WindowBlocks[window]++;
+        }
+    }
+    slot->lastAccess = now;
+
+    if ((unsigned int)pc >= (unsigned int)MemPatternSize*4) return;
+    struct AccessPattern *p = &MemPattern[pc >> 2];
+    unsigned long long count = p->loads + p->stores;
+    if (count > 0) {
+        int stride = (int)(addr - p->lastAddr);
+        if (count > 1 && stride == p->lastStride) p->sameStride++;
+        p->lastStride = stride;
+    }
+    p->lastAddr = addr;
+    if (isWrite) p->stores++; else p->loads++;
+    if (bucket >= 0) {
+        p->reused++;
+        p->reuseHist[bucket]++;
+    }
+}
+
+/**
+ * 1. Read or write memory depending on the MemRead and MemWrite control
+ * 2. Resolve branch or jump and calculate PCnext.
+ */
+void MEM() {
+  if (MemPattern != NULL && (control.MemRead || control.MemWrite)) {
+    recordMemoryAccess(datapath.PC, datapath.ALUout, control.MemWrite);
+  }
+  if (control.VectorOp) {
+    if (control.MemRead) {
+      ReadDataVector(datapath.ALUout, datapath.VMEMout);
+      TRACE("\tMEM: VLW from %d, value: %d %d %d %d\n", datapath.ALUout,
+              datapath.VMEMout[0], datapath.VMEMout[1], datapath.VMEMout[2], datapath.VMEMout[3]);
+    } // for VLW
+    if (control.MemWrite) {
+      WriteDataVector(datapath.ALUout, datapath.VTvalue);
+      TRACE("\tMEM: VSW at %d, value: %d %d %d %d\n", datapath.ALUout,
+              datapath.VTvalue[0], datapath.VTvalue[1], datapath.VTvalue[2], datapath.VTvalue[3]);
+    } // for VSW
+  } else if (control.MemRead) {
+    datapath.MEMout = ReadDataWord(datapath.ALUout);
+    
+    
+    TRACE("\tMEM: LW from %d, value: %d\n", datapath.ALUout, datapath.MEMout);
+  } // for LW|LWR instruction
+  if (control.MemWrite && !control.VectorOp) {
+    WriteDataWord(datapath.ALUout, datapath.MEMin);
+    
+    TRACE("\tMEM: SW at %d, value: %d\n", datapath.ALUout, datapath.MEMin);
+  } // for SW|SWR
+  
+  //TODO: setting datapath: PCplus4OrBTaddr and PCnext
+  
+  if(control.Branch == 1 && control.Zero != control.BranchNotEqual) {
+    datapath.PCplus4OrBTaddr = datapath.BTaddr;
+  } else {
+    datapath.PCplus4OrBTaddr = datapath.PCplus4;
+  }
+  
+  if(control.Jump == 1) {
+    datapath.PCnext = datapath.JTImm;
+    
+  } else {
+    datapath.PCnext = datapath.PCplus4OrBTaddr;
+    
+  }
+  
+  TRACE("\tMEM: PCnext: %d\n", datapath.PCnext);
+}
+/**
+ * 1. Select RWvalue
+ * 2. Write to register file if RegWrite control is set
+ */
+void WB() {
+  //TODO: setting datapath: RWvalue
+  if(control.MemtoReg == 1) {
     datapath.RWvalue = datapath.MEMout;
   } else {
     datapath.RWvalue = datapath.ALUout;
   }
   
-  if (control.RegWrite == 1) {
+  if (control.RegWrite == 1 && datapath.RWselect != 0) { // $s0 is hardwired to 0, in every engine
     RegisterFile[datapath.RWselect] = datapath.RWvalue;
   }
-  //TODO: Write to register file
-  
-  fprintf(cpusimTraceFile, "\tWB: Reg[%d] = %d\n", datapath.RWselect, datapath.RWvalue);
+  if (control.VRegWrite == 1) {
+    int *vw = VectorRegisterFile[datapath.RWselect % NUM_VECTOR_REGISTERS];
+    memcpy(vw, control.MemtoReg ? datapath.VMEMout : datapath.VALUout, sizeof(datapath.VMEMout));
+    TRACE("\tWB: VReg[%d] = %d %d %d %d\n", datapath.RWselect % NUM_VECTOR_REGISTERS,
+            vw[0], vw[1], vw[2], vw[3]);
+    return;
+  }
   
+  TRACE("\tWB: Reg[%d] = %d\n", datapath.RWselect, datapath.RWvalue);
+
+}
+
+/*
+ * Lazy datapath (--lazy-datapath 1, the default). Without the trace nothing looks at most of datapath and
+ * control between two instructions, yet fetch() .. WB() write every field of them for every instruction.
+ * lazyStep() executes the instruction with the same caches, counters and register writes, but sets only
+ * PC, PCplus4, PCnext and the register values the instruction read (RSvalue, RTvalue, RDvalue, and MEMout
+ * for a load); everything else is left stale and DatapathLazy is set. An observer that needs the signals of
+ * the instruction just executed calls materializeSignals() first, which derives them from the values kept,
+ * the same as the stages would have set them.
+ */
+int LazyDatapath = 1;
+CORE_LOCAL int DatapathLazy = 0;   // datapath and control hold only the values lazyStep() keeps
+
+/**
+ * Complete datapath and control for the instruction executed by lazyStep()
+ */
+void materializeSignals() {
+    if (!DatapathLazy) return;
+    DatapathLazy = 0;
+    decode();
+    setControlSignals();
+    datapath.RWselect = mux(datapath.RTselect, datapath.RDselect, control.RegDst);
+    datapath.ALUin2 = mux(datapath.RTvalue, datapath.Imm, control.ALUSrc);
+    datapath.MEMin = mux(datapath.RTvalue, datapath.RDvalue, control.RegDst);
+    datapath.JTImm = datapath.JTImm * 4;
+    ALU();
+    datapath.BTaddr = datapath.PCplus4 + datapath.Imm * 4;
+    if (control.Branch == 1 && control.Zero != control.BranchNotEqual) {
+        datapath.PCplus4OrBTaddr = datapath.BTaddr;
+    } else {
+        datapath.PCplus4OrBTaddr = datapath.PCplus4;
+    }
+    datapath.RWvalue = control.MemtoReg == 1 ? datapath.MEMout : datapath.ALUout;
+}
+
+/**
+ * One instruction of the detailed engine without the signals nobody reads. The vector instructions, and
+ * func codes that are not instructions (which keep the control signals of the instruction before), go
+ * through the stages.
+ */
+void lazyStep() {
+    fetch();
+    union InstructionWord iw = *(union InstructionWord *) &IR;
+    unsigned int func = iw.iType.func;
+    unsigned int rs = iw.rType.Rs, rt = iw.rType.Rt, rd = iw.rType.Rd;
+    int imm = iw.iType.Imm;
+    unsigned int a = RegisterFile[rs], b = RegisterFile[rt], addr;
+    datapath.RSvalue = a;
+    datapath.RTvalue = b;
+    datapath.RDvalue = RegisterFile[rd];
+    datapath.PCnext = datapath.PCplus4;
+    DatapathLazy = 1;
+    switch (func) {
+        case ADD:  RegisterFile[rd] = a + b; break;
+        case SUB:  RegisterFile[rd] = a - b; break;
+        case MUL:  RegisterFile[rd] = a * b; break;
+        case AND:  RegisterFile[rd] = a & b; break;
+        case OR:   RegisterFile[rd] = a | b; break;
+        case XOR:  RegisterFile[rd] = a ^ b; break;
+        case SLT:  RegisterFile[rd] = (int)a < (int)b; break;
+        case SLL:  RegisterFile[rt] = a << (imm & 31); break;
+        case SRL:  RegisterFile[rt] = a >> (imm & 31); break;
+        case ADDI: RegisterFile[rt] = a + imm; break;
+        case LW:
+        case LWR:
+            addr = func == LW ? a + imm : a + b;
+            if (MemPattern != NULL) recordMemoryAccess(datapath.PC, addr, 0);
+            datapath.MEMout = ReadDataWord(addr);
+            RegisterFile[func == LW ? rt : rd] = datapath.MEMout;
+            break;
+        case SW:
+        case SWR:
+            addr = func == SW ? a + imm : a + b;
+            if (MemPattern != NULL) recordMemoryAccess(datapath.PC, addr, 1);
+            WriteDataWord(addr, func == SW ? b : datapath.RDvalue);
+            break;
+        case BEQ:
+        case BNE:
+            if ((a == b) == (func == BEQ)) datapath.PCnext = datapath.PCplus4 + imm * 4;
+            break;
+        case J:
+            datapath.PCnext = iw.jType.Imm * 4;
+            break;
+        default:
+            DatapathLazy = 0;
+            decode();
+            controlAndRegisterFetch();
+            EXE();
+            MEM();
+            WB();
+    }
+    RegisterFile[0] = 0;   // $s0 is hardwired to 0, as in WB()
+}
+
+
+/**
+ * Workload configuration. Everything that used to be hardcoded in main() (the array size, where A and B
+ * live in DataMemory, the random seed) can now be set from the command line or from a config file so that
+ * runs are reproducible and the problem size can be scaled.
+ */
+#define DATA_MEMORY_SIZE (1024*1024*1024)
+#define MAX_INIT_OVERRIDES 64
+
+struct RegisterInit {
+    int reg;
+    int value;
+};
+
+struct MemoryInit {
+    unsigned int addr;
+    int value;
+};
+
+#define ENGINE_DETAILED 0
+#define ENGINE_FAST 1
+#define ENGINE_JIT 2
+
+struct SimConfig {
+    unsigned long long seed;         // seed of the PRNG used to fill B
+    int N;                           // number of int elements in each of A and B
+    unsigned int ABase;              // byte address of A in DataMemory, goes to $s1
+    unsigned int BBase;              // byte address of B in DataMemory, goes to $s2, defaults to right after A
+    int BBaseSet;                    // set if BBase was given explicitly
+    struct RegisterInit regInit[MAX_INIT_OVERRIDES]; // initial register contents, applied after A/B setup
+    int numRegInit;
+    struct MemoryInit memInit[MAX_INIT_OVERRIDES];   // initial memory words, applied after B is filled
+    int numMemInit;
+    char workload[32];               // name of the workload, selects the init and verification functions
+    long maxMismatches;              // at most this many verification failures are written to the trace
+    char profile[256];               // if set, the per-PC profile is collected and the report written to this file
+    char memProfile[256];            // if set, LW/SW addresses are analyzed and the report written to this file
+    long memWindow;                  // number of memory accesses per working-set window
+    int engine;                      // ENGINE_DETAILED, ENGINE_FAST or ENGINE_JIT
+    int hostPerf;                    // read the host performance counters around the simulation loop
+    long hostPerfSample;             // the detailed engine measures the stages of 1 in this many instructions
+    int traceAsync;                  // format and write the trace on a writer thread
+    char traceOut[256];              // if set, the compressed binary trace is written to this file
+    long traceChunk;                 // instructions per chunk of the binary trace
+    long jitThreshold;               // the JIT translates a block once it has been entered this many times
+    int cores;                       // simulated cores running the program
+    int parallel;                    // run each core on its own host thread
+    long quantum;                    // instructions per core between two barriers of a parallel run
+    int deterministic;               // buffer the stores of a parallel run until the end of each epoch
+    int timing;                      // run the timing model: cycles, the scoreboard and the MSHRs
+    char bbv[256];                   // if set, the fast engine writes the basic block vectors to this file
+    long bbvInterval;                // instructions per basic block vector
+    char stats[256];                 // if set, the detailed engine writes the interval statistics to this file
+    long statsInterval;              // instructions, or cycles with statsByCycles, per row of the statistics
+    int statsByCycles;
+} config = { 1, 256, 0, 0, 0, {{0}}, 0, {{0}}, 0, "conv3", 10, "", "", 4096, ENGINE_DETAILED, 0, 64, 1, "", 65536, 16, 1,
+             0, 1000, 1, 0, "", 100000, "", 100000, 0 };
+
+/**
+ * Fill an int array with pseudo random numbers in the range of rand(), i.e. [0, 2^31).
+ * Four independent xorshift128+ generators are stepped in lock-step so the compiler can keep all the
+ * lanes in vector registers; this is much faster than calling rand() for large arrays and, unlike
+ * rand(), the sequence is the same on every platform for a given seed.
+ * @param array
+ * @param n
+ * @param seed
+ */
+void FillRandom(int *array, long n, unsigned long long seed) {
+    unsigned long long s0[4], s1[4];
+    int lane;
+    /* splitmix64 to expand the seed into the state of each lane */
+    unsigned long long z = seed;
+    for (lane = 0; lane < 4; lane++) {
+        int k;
+        for (k = 0; k < 2; k++) {
+            z += 0x9E3779B97F4A7C15ULL;
+            unsigned long long x = z;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            x = x ^ (x >> 31);
+            if (k == 0) s0[lane] = x; else s1[lane] = x;
+        }
+    }
+
+    long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (lane = 0; lane < 4; lane++) {
+            unsigned long long x = s0[lane];
+            unsigned long long y = s1[lane];
+            s0[lane] = y;
+            x ^= x << 23;
+            s1[lane] = x ^ y ^ (x >> 17) ^ (y >> 26);
+            array[i + lane] = (int)((s1[lane] + y) >> 33);
+        }
+    }
+    for (lane = 0; i < n; i++, lane++) {
+        unsigned long long x = s0[lane];
+        unsigned long long y = s1[lane];
+        x ^= x << 23;
+        array[i] = (int)(((x ^ y ^ (x >> 17) ^ (y >> 26)) + y) >> 33);
+    }
+}
+
+/**
+ * Parse "a=b" into two numbers, both may be decimal or 0x hex.
+ * @return 1 on success, 0 if the string is malformed
+ */
+int parsePair(const char *str, long long *first, long long *second) {
+    char *end;
+    *first = strtoll(str, &end, 0);
+    if (end == str || *end != '=') return 0;
+    const char *rest = end + 1;
+    *second = strtoll(rest, &end, 0);
+    if (end == rest || *end != '\0') return 0;
+    return 1;
+}
+
+/**
+ * Apply one configuration option. The same keys are accepted on the command line (as --key value)
+ * and in a config file (as "key value" lines).
+ * @return 1 if the option is valid, 0 otherwise
+ */
+int setConfigOption(const char *key, const char *value) {
+    char *end;
+    int cacheOption = setCacheOption(key, value);
+    if (cacheOption >= 0) return cacheOption;
+    int dramOption = setDRAMOption(key, value);
+    if (dramOption >= 0) return dramOption;
+    int mmuOption = setMMUOption(key, value);
+    if (mmuOption >= 0) return mmuOption;
+    if (strcmp(key, "seed") == 0) {
+        if (strcmp(value, "time") == 0) {
+            config.seed = (unsigned long long)time(NULL); /* the old non-reproducible behavior */
+            return 1;
+        }
+        config.seed = strtoull(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "n") == 0) {
+        long n = strtol(value, &end, 0);
+        if (end == value || *end != '\0' || n < 4 || n > INT_MAX) return 0;
+        config.N = (int)n;
+        return 1;
+    } else if (strcmp(key, "a-base") == 0) {
+        config.ABase = (unsigned int)strtoul(value, &end, 0);
+        return end != value && *end == '\0' && config.ABase % 4 == 0;
+    } else if (strcmp(key, "b-base") == 0) {
+        config.BBase = (unsigned int)strtoul(value, &end, 0);
+        config.BBaseSet = 1;
+        return end != value && *end == '\0' && config.BBase % 4 == 0;
+    } else if (strcmp(key, "workload") == 0) {
+        if (strlen(value) >= sizeof(config.workload)) return 0;
+        strcpy(config.workload, value);
+        return 1;
+    } else if (strcmp(key, "max-mismatches") == 0) {
+        config.maxMismatches = strtol(value, &end, 0);
+        return end != value && *end == '\0' && config.maxMismatches >= 0;
+    } else if (strcmp(key, "profile") == 0) {
+        if (strlen(value) >= sizeof(config.profile)) return 0;
+        strcpy(config.profile, value);
+        return 1;
+    } else if (strcmp(key, "mem-profile") == 0) {
+        if (strlen(value) >= sizeof(config.memProfile)) return 0;
+        strcpy(config.memProfile, value);
+        return 1;
+    } else if (strcmp(key, "mem-window") == 0) {
+        config.memWindow = strtol(value, &end, 0);
+        return end != value && *end == '\0' && config.memWindow > 0;
+    } else if (strcmp(key, "trace") == 0) {
+        TraceEnabled = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "cores") == 0) {
+        config.cores = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && config.cores >= 1 && config.cores <= MAX_CORES;
+    } else if (strcmp(key, "parallel") == 0) {
+        config.parallel = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "quantum") == 0) {
+        config.quantum = strtol(value, &end, 0);
+        return end != value && *end == '\0' && config.quantum > 0;
+    } else if (strcmp(key, "deterministic") == 0) {
+        config.deterministic = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "timing") == 0) {
+        config.timing = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "mshrs") == 0) {
+        DMSHR.numEntries = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && DMSHR.numEntries >= 0 && DMSHR.numEntries <= MAX_MSHRS;
+    } else if (strcmp(key, "mem-latency") == 0) {
+        DMSHR.latency = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0' && DMSHR.latency > 0;
+    } else if (strcmp(key, "lazy-datapath") == 0) {
+        LazyDatapath = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "trace-async") == 0) {
+        config.traceAsync = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "trace-out") == 0) {
+        if (strlen(value) >= sizeof(config.traceOut)) return 0;
+        strcpy(config.traceOut, value);
+        return 1;
+    } else if (strcmp(key, "trace-chunk") == 0) {
+        config.traceChunk = strtol(value, &end, 0);
+        return end != value && *end == '\0' && config.traceChunk > 0 && config.traceChunk <= 1 << 24;
+    } else if (strcmp(key, "bbv") == 0) {
+        if (strlen(value) >= sizeof(config.bbv)) return 0;
+        strcpy(config.bbv, value);
+        return 1;
+    } else if (strcmp(key, "bbv-interval") == 0) {
+        config.bbvInterval = strtol(value, &end, 0);
+        return end != value && *end == '\0' && config.bbvInterval > 0;
+    } else if (strcmp(key, "stats") == 0) {
+        if (strlen(value) >= sizeof(config.stats)) return 0;
+        strcpy(config.stats, value);
+        return 1;
+    } else if (strcmp(key, "stats-interval") == 0) {
+        config.statsInterval = strtol(value, &end, 0);
+        return end != value && *end == '\0' && config.statsInterval > 0;
+    } else if (strcmp(key, "stats-unit") == 0) {
+        if (strcmp(value, "instructions") == 0) config.statsByCycles = 0;
+        else if (strcmp(value, "cycles") == 0) config.statsByCycles = 1;
+        else return 0;
+        return 1;
+    } else if (strcmp(key, "host-perf") == 0) {
+        config.hostPerf = (int)strtol(value, &end, 0);
+        return end != value && *end == '\0';
+    } else if (strcmp(key, "host-perf-sample") == 0) {
+        config.hostPerfSample = strtol(value, &end, 0);
+        return end != value && *end == '\0' && config.hostPerfSample > 0;
+    } else if (strcmp(key, "engine") == 0) {
+        if (strcmp(value, "detailed") == 0) config.engine = ENGINE_DETAILED;
+        else if (strcmp(value, "fast") == 0) config.engine = ENGINE_FAST;
+        else if (strcmp(value, "jit") == 0) config.engine = ENGINE_JIT;
+        else return 0;
+        return 1;
+    } else if (strcmp(key, "jit-threshold") == 0) {
+        config.jitThreshold = strtol(value, &end, 0);
+        return end != value && *end == '\0' && config.jitThreshold > 0 && config.jitThreshold < 1L << 31;
+    } else if (strcmp(key, "reg") == 0) {
+        long long reg, v;
+        if (!parsePair(value, &reg, &v) || reg < 0 || reg > 31 || config.numRegInit == MAX_INIT_OVERRIDES) return 0;
+        config.regInit[config.numRegInit].reg = (int)reg;
+        config.regInit[config.numRegInit].value = (int)v;
+        config.numRegInit++;
+        return 1;
+    } else if (strcmp(key, "mem") == 0) {
+        long long addr, v;
+        if (!parsePair(value, &addr, &v) || addr < 0 || addr % 4 != 0 || addr + 4 > DATA_MEMORY_SIZE
+            || config.numMemInit == MAX_INIT_OVERRIDES) return 0;
+        config.memInit[config.numMemInit].addr = (unsigned int)addr;
+        config.memInit[config.numMemInit].value = (int)v;
+        config.numMemInit++;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Read a config file. Each line is "key value" (e.g. "n 4096", "reg 4=4096", "mem 0x1000=7"),
+ * blank lines and lines starting with # are ignored.
+ * @return 1 on success, 0 on any error (which is reported)
+ */
+int readConfigFile(const char *fileName) {
+    FILE *file = fopen(fileName, "r");
+    if (file == NULL) {
+        printf("Could not open config file %s\n", fileName);
+        return 0;
+    }
+    char line[256];
+    int lineNo = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char key[64], value[192];
+        lineNo++;
+        char *ptr = line;
+        while (*ptr == ' ' || *ptr == '\t') ptr++;
+        if (*ptr == '#' || *ptr == '\r' || *ptr == '\n' || *ptr == '\0') continue;
+        if (sscanf(ptr, "%63s %191s", key, value) != 2 || !setConfigOption(key, value)) {
+            printf("%s:%d: invalid config line: %s", fileName, lineNo, ptr);
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+/**
+ * Execute the instruction at pc on the architectural state only (PC, RegisterFile, VectorRegisterFile and
+ * DataMemory). The step of the fast engine, and of the JIT for the blocks it has not translated.
+ * @return the PC of the next instruction
+ */
+static inline __attribute__((always_inline)) unsigned int fastStep(unsigned int pc, int *R) {
+    unsigned int iw = *(unsigned int*)&InstructionMemory[pc];
+    unsigned int func = iw >> 26;
+    unsigned int rs = (iw >> 21) & 31;
+    unsigned int rt = (iw >> 16) & 31;
+    unsigned int rd = (iw >> 11) & 31;
+    int imm = (short)(iw & 0xFFFF);
+    unsigned int next = pc + 4;
+    switch (func) {
+        case ADD:  R[rd] = (int)((unsigned int)R[rs] + (unsigned int)R[rt]); break;
+        case SUB:  R[rd] = (int)((unsigned int)R[rs] - (unsigned int)R[rt]); break;
+        case MUL:  R[rd] = (int)((unsigned int)R[rs] * (unsigned int)R[rt]); break;
+        case AND:  R[rd] = R[rs] & R[rt]; break;
+        case OR:   R[rd] = R[rs] | R[rt]; break;
+        case XOR:  R[rd] = R[rs] ^ R[rt]; break;
+        case SLT:  R[rd] = R[rs] < R[rt]; break;
+        case ADDI: R[rt] = (int)((unsigned int)R[rs] + (unsigned int)imm); break;
+        case SLL:  R[rt] = (int)((unsigned int)R[rs] << (imm & 31)); break;
+        case SRL:  R[rt] = (int)((unsigned int)R[rs] >> (imm & 31)); break;
+        case LW:   R[rt] = ReadDataMemoryWord((unsigned int)(R[rs] + imm)); break;
+        case SW:   WriteDataMemoryWord((unsigned int)(R[rs] + imm), R[rt]); break;
+        case LWR:  R[rd] = ReadDataMemoryWord((unsigned int)(R[rs] + R[rt])); break;
+        case SWR:  WriteDataMemoryWord((unsigned int)(R[rs] + R[rt]), R[rd]); break;
+        case BEQ:  if (R[rs] == R[rt]) next += imm * 4; break;
+        case BNE:  if (R[rs] != R[rt]) next += imm * 4; break;
+        case J:    next = (unsigned int)(((int)(iw << 6) >> 6) * 4); break;
+        case VLW: {
+            const char *src = &DataMemory[(unsigned int)(R[rs] + imm)];
+#ifdef __SSE2__
+            _mm_storeu_si128((__m128i*)VectorRegisterFile[rt % NUM_VECTOR_REGISTERS], _mm_loadu_si128((const __m128i*)src));
+#else
+            memcpy(VectorRegisterFile[rt % NUM_VECTOR_REGISTERS], src, sizeof(VectorRegisterFile[0]));
+#endif
+            break;
+        }
+        case VSW: {
+            char *dst = &DataMemory[(unsigned int)(R[rs] + imm)];
+#ifdef __SSE2__
+            _mm_storeu_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)VectorRegisterFile[rt % NUM_VECTOR_REGISTERS]));
+#else
+            memcpy(dst, VectorRegisterFile[rt % NUM_VECTOR_REGISTERS], sizeof(VectorRegisterFile[0]));
+#endif
+            break;
+        }
+        case VADD: {
+            int *vd = VectorRegisterFile[rd % NUM_VECTOR_REGISTERS];
+            const int *vs = VectorRegisterFile[rs % NUM_VECTOR_REGISTERS];
+            const int *vt = VectorRegisterFile[rt % NUM_VECTOR_REGISTERS];
+#ifdef __SSE2__
+            _mm_storeu_si128((__m128i*)vd, _mm_add_epi32(_mm_loadu_si128((const __m128i*)vs), _mm_loadu_si128((const __m128i*)vt)));
+#else
+            int k;
+            for (k = 0; k < VECTOR_WORDS; k++) vd[k] = (int)((unsigned int)vs[k] + (unsigned int)vt[k]);
+#endif
+            break;
+        }
+    }
+    R[0] = 0;   // $s0 is hardwired to 0, as in WB()
+    return next;
+}
+
+/**
+ * Fast functional engine. Runs the program straight out of InstructionMemory and only updates the
+ * architectural state: there is no datapath, no control signals, no cache model, no trace and no profile.
+ * The vector instructions map onto host SIMD.
+ * Termination follows the detailed engine: a jump past instruction 9999 or back to PC 0.
+ * @return the number of instructions executed
+ */
+long long runFast(int entry) {
+    unsigned int pc = entry;
+    int *R = RegisterFile;
+    long long count = 0;
+    for (;;) {
+        pc = fastStep(pc, R);
+        count++;
+        if (pc >= 9999 || pc == 0) break;
+    }
+    PC = pc;
+    return count;
+}
+
+/*
+ * Basic block vectors (--bbv <file>, fast engine), the input of SimPoint style phase analysis. A basic block
+ * runs from the instruction after a BEQ, BNE or J to the next one, and is numbered from 1 in the order it
+ * first runs. The run is cut into intervals of config.bbvInterval instructions, each one closed at the end of
+ * the block crossing that count, and each interval is one line giving the instructions executed in each block:
+ *   T:<block>:<instructions> :<block>:<instructions> ...
+ * The simpoint tool clusters the lines and picks the intervals worth simulating in detail.
+ */
+#define BBV_SLOTS (10000/4)                  // one per instruction below PC 9999, where programs end
+
+unsigned int BBVId[BBV_SLOTS];               // number of the block starting at each PC, 0 if none has run yet
+unsigned long long BBVCount[BBV_SLOTS + 1];  // instructions executed in each block in the current interval
+unsigned int BBVNumBlocks = 0;
+unsigned long long BBVIntervals = 0;
+FILE *BBVFile = NULL;
+
+static void writeBBVInterval(FILE *file) {
+    unsigned int id;
+    fputc('T', file);
+    for (id = 1; id <= BBVNumBlocks; id++) {
+        if (BBVCount[id] == 0) continue;
+        fprintf(file, ":%u:%llu ", id, BBVCount[id]);
+        BBVCount[id] = 0;
+    }
+    fputc('\n', file);
+    BBVIntervals++;
+}
+
+/**
+ * The fast engine, counting the instructions of every basic block and writing one vector per interval
+ * @return the number of instructions executed
+ */
+long long runFastBBV(int entry, FILE *file) {
+    unsigned int pc = entry, blockStart = entry, blockLength = 0;
+    int *R = RegisterFile;
+    long long count = 0, intervalEnd = config.bbvInterval;
+    for (;;) {
+        unsigned int func = *(unsigned int*)&InstructionMemory[pc] >> 26;
+        unsigned int next = fastStep(pc, R);
+        count++;
+        blockLength++;
+        int done = next >= 9999 || next == 0;
+        if (func == BEQ || func == BNE || func == J || done) {
+            unsigned int *id = &BBVId[blockStart/4];
+            if (*id == 0) *id = ++BBVNumBlocks;
+            BBVCount[*id] += blockLength;
+            blockStart = next;
+            blockLength = 0;
+            if (count >= intervalEnd || done) {
+                writeBBVInterval(file);
+                intervalEnd = count + config.bbvInterval;
+            }
+        }
+        pc = next;
+        if (done) break;
+    }
+    PC = pc;
+    return count;
+}
+
+/**
+ * JIT tier of the fast engine (--engine jit). The functional engine counts how often each basic block is
+ * entered, and once a block has been entered config.jitThreshold times it is translated to x86-64 code in an
+ * executable mmap buffer. A block runs from its first instruction to the first BEQ, BNE or J (included), or
+ * up to the first instruction the translator leaves to the interpreter (the vector ones), at most
+ * JIT_MAX_BLOCK instructions. The most used guest registers of a block stay in host registers while it runs
+ * and are written back to RegisterFile when it exits, and a block whose branch goes back to its own start
+ * (the inner loop of a kernel) loops in native code without going back to the dispatcher.
+ * Like the fast engine the JIT only keeps the architectural state: the cache model, the trace and the
+ * profile need the detailed engine.
+ *
+ * A translated block is called as  unsigned int block(int *R, char *DataMemory, long long *count)  and
+ * returns the next PC after adding the number of instructions it executed to *count.
+ */
+#if defined(__x86_64__) && defined(__linux__)
+#define HAVE_JIT 1
+#endif
+
+#define JIT_MAX_BLOCK 64
+#define JIT_SLOTS (10000/4)                  // one per instruction below PC 9999, where programs end
+#define JIT_BUFFER_BYTES (4 << 20)
+#define JIT_MAX_BLOCK_BYTES (64 + JIT_MAX_BLOCK*48)   // prologue, epilogue and the longest instruction sequences
+
+/* x86-64 register numbers */
+#define X86_RAX 0
+#define X86_RCX 1
+#define X86_RDX 2
+#define X86_RBX 3
+#define X86_RBP 5
+#define X86_RSI 6
+#define X86_RDI 7
+#define X86_R8  8
+#define X86_R9  9
+#define X86_R10 10
+#define X86_R11 11
+#define X86_R12 12
+#define X86_R13 13
+#define X86_R14 14
+#define X86_R15 15
+
+/* condition codes of jcc */
+#define X86_CC_E 0x4
+#define X86_CC_NE 0x5
+
+/*
+ * Host registers during a block: rdi = RegisterFile, rsi = DataMemory, rdx = the count pointer,
+ * r8 = instructions executed, rax and rcx are scratch, and the guest registers are given these:
+ */
+#define JIT_HOST_REGS 9
+const int JitHostRegs[JIT_HOST_REGS] = { X86_RBX, X86_RBP, X86_R12, X86_R13, X86_R14, X86_R15, X86_R9, X86_R10, X86_R11 };
+#define IsCalleeSaved(r) ((r) == X86_RBX || (r) == X86_RBP || (r) >= X86_R12)
+
+typedef unsigned int (*JitBlock)(int *R, char *memory, long long *count);
+
+JitBlock JitCode[JIT_SLOTS];                 // translated block starting at each PC, or NULL
+unsigned int JitHeat[JIT_SLOTS];             // times the block at each PC was entered by the interpreter
+unsigned char *JitBuffer;
+size_t JitUsed;
+unsigned long long JitBlocks = 0;            // blocks translated
+long long JitNativeInstructions = 0;         // instructions executed in translated blocks
+
+struct JitEmitter {
+    unsigned char *p;
+    unsigned char *exits[2*JIT_MAX_BLOCK];   // rel32 of the jumps to the epilogue
+    int numExits;
+};
+
+static void emit8(struct JitEmitter *e, int b) { *e->p++ = (unsigned char)b; }
+
+static void emit32(struct JitEmitter *e, unsigned int v) {
+    memcpy(e->p, &v, 4);
+    e->p += 4;
+}
+
+/* REX prefix for a 32-bit (w = 0) or 64-bit (w = 1) operation, left out when nothing needs it */
+static void emitRex(struct JitEmitter *e, int w, int reg, int rm) {
+    int rex = 0x40 | w << 3 | (reg >> 3) << 2 | (rm >> 3);
+    if (rex != 0x40) emit8(e, rex);
+}
+
+/* op reg, rm between two registers; a two byte opcode is given as 0x0Fxx */
+static void emitRR(struct JitEmitter *e, int op, int reg, int rm) {
+    emitRex(e, 0, reg, rm);
+    if (op > 0xFF) emit8(e, op >> 8);
+    emit8(e, op & 0xFF);
+    emit8(e, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* op reg, [rdi + 4*guest], i.e. a guest register in RegisterFile */
+static void emitGuest(struct JitEmitter *e, int op, int reg, int guest) {
+    emitRex(e, 0, reg, X86_RDI);
+    emit8(e, op);
+    emit8(e, 0x40 | (reg & 7) << 3 | X86_RDI);
+    emit8(e, guest*4);
+}
+
+/* op reg, [rsi + rax], i.e. a word of DataMemory at the address in eax */
+static void emitData(struct JitEmitter *e, int op, int reg) {
+    emitRex(e, 0, reg, 0);
+    emit8(e, op);
+    emit8(e, 0x04 | (reg & 7) << 3);
+    emit8(e, 0x06);                          /* SIB: base rsi, index rax, scale 1 */
+}
+
+/* add rm, imm32 (ext 0) and the other group 1 operations */
+static void emitImm(struct JitEmitter *e, int w, int ext, int rm, unsigned int imm) {
+    emitRex(e, w, 0, rm);
+    emit8(e, 0x81);
+    emit8(e, 0xC0 | ext << 3 | (rm & 7));
+    emit32(e, imm);
+}
+
+static void emitPush(struct JitEmitter *e, int r, int pop) {
+    if (r >= 8) emit8(e, 0x41);
+    emit8(e, (pop ? 0x58 : 0x50) + (r & 7));
+}
+
+/* the host register holding guest register r for reading, loading it into scratch if it has none */
+static int jitRead(struct JitEmitter *e, const int *host, int r, int scratch) {
+    if (r == 0) {
+        emitRR(e, 0x31, scratch, scratch);   /* xor, $0 reads as 0 */
+        return scratch;
+    }
+    if (host[r] >= 0) return host[r];
+    emitGuest(e, 0x8B, scratch, r);
+    return scratch;
+}
+
+/* write the host register src to guest register r, writes to $0 are dropped */
+static void jitWrite(struct JitEmitter *e, const int *host, int r, int src) {
+    if (r == 0) return;
+    if (host[r] < 0) emitGuest(e, 0x89, src, r);
+    else if (host[r] != src) emitRR(e, 0x89, src, host[r]);
+}
+
+/* eax = guest register r, the start of an address or of an ALU result */
+static void jitReadEax(struct JitEmitter *e, const int *host, int r) {
+    int a = jitRead(e, host, r, X86_RAX);
+    if (a != X86_RAX) emitRR(e, 0x89, a, X86_RAX);
+}
+
+/* leave the block after count instructions for next, or loop back to its top */
+static void jitExit(struct JitEmitter *e, unsigned int start, unsigned char *loopTop, unsigned int next, int count) {
+    emitImm(e, 1, 0, X86_R8, count);         /* add r8, count */
+    if (next == start && start != 0) {
+        emit8(e, 0xE9);
+        emit32(e, (unsigned int)(loopTop - (e->p + 4)));
+        return;
+    }
+    emit8(e, 0xB8);                          /* mov eax, next */
+    emit32(e, next);
+    emit8(e, 0xE9);
+    e->exits[e->numExits++] = e->p;
+    emit32(e, 0);
+}
+
+static int jitSupported(unsigned int func) {
+    switch (func) {
+        case ADD: case SUB: case MUL: case AND: case OR: case XOR: case SLT: case ADDI: case SLL: case SRL:
+        case LW: case SW: case LWR: case SWR: case BEQ: case BNE: case J:
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Translate the block starting at start.
+ * @return the native code, or NULL if the block cannot be translated or the code buffer is full
+ */
+JitBlock jitTranslate(unsigned int start) {
+    unsigned int iw[JIT_MAX_BLOCK];
+    int n = 0, i, k, r;
+    unsigned int pc = start;
+    if (JitUsed + JIT_MAX_BLOCK_BYTES > JIT_BUFFER_BYTES) return NULL;
+    while (n < JIT_MAX_BLOCK && pc < 9999) {
+        unsigned int w = *(unsigned int*)&InstructionMemory[pc];
+        unsigned int func = w >> 26;
+        if (!jitSupported(func)) break;
+        iw[n++] = w;
+        pc += 4;
+        if (func == BEQ || func == BNE || func == J) break;
+    }
+    if (n == 0) return NULL;
+
+    /* the most used guest registers get the host registers */
+    int uses[32] = {0}, written[32] = {0}, host[32];
+    for (i = 0; i < n; i++) {
+        unsigned int func = iw[i] >> 26, rs = (iw[i] >> 21) & 31, rt = (iw[i] >> 16) & 31, rd = (iw[i] >> 11) & 31;
+        if (func == J) continue;
+        uses[rs]++;
+        if (func != ADDI && func != SLL && func != SRL && func != LW) uses[rt]++;
+        if (func <= SWR && func != ADDI && func != LW && func != SW) uses[rd]++;   /* the R-type ones */
+        if (func == ADDI || func == SLL || func == SRL || func == LW) written[rt] = 1;
+        else if (func <= SWR && func != SW && func != SWR) written[rd] = 1;
+    }
+    int used[JIT_HOST_REGS] = {0};
+    uses[0] = 0;                             /* $0 is never kept, it reads as 0 */
+    for (r = 0; r < 32; r++) host[r] = -1;
+    for (k = 0; k < JIT_HOST_REGS; k++) {
+        int best = 0;
+        for (r = 1; r < 32; r++) {
+            if (host[r] < 0 && uses[r] > uses[best]) best = r;
+        }
+        if (best == 0) break;
+        host[best] = JitHostRegs[k];
+        used[k] = 1;
+    }
+
+    struct JitEmitter e;
+    e.p = JitBuffer + JitUsed;
+    e.numExits = 0;
+    unsigned char *code = e.p;
+    for (k = 0; k < JIT_HOST_REGS; k++) {
+        if (used[k] && IsCalleeSaved(JitHostRegs[k])) emitPush(&e, JitHostRegs[k], 0);
+    }
+    emitRR(&e, 0x31, X86_R8, X86_R8);       /* xor r8d, r8d */
+    for (r = 1; r < 32; r++) {
+        if (host[r] >= 0) emitGuest(&e, 0x8B, host[r], r);
+    }
+    unsigned char *loopTop = e.p;
+
+    pc = start;
+    for (i = 0; i < n; i++, pc += 4) {
+        unsigned int func = iw[i] >> 26;
+        int rs = (iw[i] >> 21) & 31, rt = (iw[i] >> 16) & 31, rd = (iw[i] >> 11) & 31;
+        int imm = (short)(iw[i] & 0xFFFF);
+        int b, v;
+        switch (func) {
+            case ADD: case SUB: case MUL: case AND: case OR: case XOR: case SLT:
+                if (rd == 0) break;
+                jitReadEax(&e, host, rs);
+                b = jitRead(&e, host, rt, X86_RCX);
+                switch (func) {
+                    case ADD: emitRR(&e, 0x01, b, X86_RAX); break;
+                    case SUB: emitRR(&e, 0x29, b, X86_RAX); break;
+                    case MUL: emitRR(&e, 0x0FAF, X86_RAX, b); break;
+                    case AND: emitRR(&e, 0x21, b, X86_RAX); break;
+                    case OR:  emitRR(&e, 0x09, b, X86_RAX); break;
+                    case XOR: emitRR(&e, 0x31, b, X86_RAX); break;
+                    case SLT:
+                        emitRR(&e, 0x39, b, X86_RAX);                 /* cmp eax, b */
+                        emit8(&e, 0x0F); emit8(&e, 0x9C); emit8(&e, 0xC0);   /* setl al */
+                        emit8(&e, 0x0F); emit8(&e, 0xB6); emit8(&e, 0xC0);   /* movzx eax, al */
+                        break;
+                }
+                jitWrite(&e, host, rd, X86_RAX);
+                break;
+            case ADDI:
+                if (rt == 0) break;
+                if (rt == rs && host[rt] >= 0) {
+                    if (imm) emitImm(&e, 0, 0, host[rt], (unsigned int)imm);
+                    break;
+                }
+                jitReadEax(&e, host, rs);
+                if (imm) emitImm(&e, 0, 0, X86_RAX, (unsigned int)imm);
+                jitWrite(&e, host, rt, X86_RAX);
+                break;
+            case SLL: case SRL:
+                if (rt == 0) break;
+                jitReadEax(&e, host, rs);
+                emit8(&e, 0xC1); emit8(&e, 0xC0 | (func == SLL ? 4 : 5) << 3); emit8(&e, imm & 31);
+                jitWrite(&e, host, rt, X86_RAX);
+                break;
+            case LW: case LWR:
+                if ((func == LW ? rt : rd) == 0) break;
+                jitReadEax(&e, host, rs);     /* the 32-bit address, zero extended into rax */
+                if (func == LW) {
+                    if (imm) emitImm(&e, 0, 0, X86_RAX, (unsigned int)imm);
+                } else {
+                    emitRR(&e, 0x01, jitRead(&e, host, rt, X86_RCX), X86_RAX);
+                }
+                r = func == LW ? rt : rd;
+                v = host[r] >= 0 ? host[r] : X86_RCX;
+                emitData(&e, 0x8B, v);
+                jitWrite(&e, host, r, v);
+                break;
+            case SW: case SWR:
+                jitReadEax(&e, host, rs);
+                if (func == SW) {
+                    if (imm) emitImm(&e, 0, 0, X86_RAX, (unsigned int)imm);
+                } else {
+                    emitRR(&e, 0x01, jitRead(&e, host, rt, X86_RCX), X86_RAX);
+                }
+                emitData(&e, 0x89, jitRead(&e, host, func == SW ? rt : rd, X86_RCX));
+                break;
+            case BEQ: case BNE: {
+                int a = jitRead(&e, host, rs, X86_RAX);
+                b = jitRead(&e, host, rt, X86_RCX);
+                emitRR(&e, 0x39, b, a);                              /* cmp a, b */
+                emit8(&e, 0x0F);                                     /* not taken: jump over the taken exit */
+                emit8(&e, 0x80 | (func == BEQ ? X86_CC_NE : X86_CC_E));
+                unsigned char *notTaken = e.p;
+                emit32(&e, 0);
+                jitExit(&e, start, loopTop, pc + 4 + (unsigned int)imm*4, i + 1);
+                unsigned int rel = (unsigned int)(e.p - (notTaken + 4));
+                memcpy(notTaken, &rel, 4);
+                jitExit(&e, start, loopTop, pc + 4, i + 1);
+                break;
+            }
+            case J:
+                jitExit(&e, start, loopTop, (unsigned int)(((int)(iw[i] << 6) >> 6) * 4), i + 1);
+                break;
+        }
+    }
+    if (!(iw[n-1] >> 26 == BEQ || iw[n-1] >> 26 == BNE || iw[n-1] >> 26 == J)) jitExit(&e, start, loopTop, pc, n);
+
+    /* the epilogue: write back the guest registers, add up the count and return the next PC in eax */
+    for (i = 0; i < e.numExits; i++) {
+        unsigned int rel = (unsigned int)(e.p - (e.exits[i] + 4));
+        memcpy(e.exits[i], &rel, 4);
+    }
+    for (r = 1; r < 32; r++) {
+        if (host[r] >= 0 && written[r]) emitGuest(&e, 0x89, host[r], r);
+    }
+    emit8(&e, 0x4C); emit8(&e, 0x01); emit8(&e, 0x02);      /* add [rdx], r8 */
+    for (k = JIT_HOST_REGS - 1; k >= 0; k--) {
+        if (used[k] && IsCalleeSaved(JitHostRegs[k])) emitPush(&e, JitHostRegs[k], 1);
+    }
+    emit8(&e, 0xC3);
+    JitUsed = (size_t)(e.p - JitBuffer);
+    JitBlocks++;
+    return (JitBlock)code;
+}
+
+/**
+ * The JIT engine: the fast engine's dispatcher, running the translated blocks and interpreting the others
+ * one block at a time while they are cold.
+ * @return the number of instructions executed
+ */
+long long runJit(int entry) {
+#ifdef HAVE_JIT
+    JitBuffer = (unsigned char*) mmap(NULL, JIT_BUFFER_BYTES, PROT_READ | PROT_WRITE | PROT_EXEC,
+                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (JitBuffer == MAP_FAILED) {
+        printf("No executable memory for the JIT, running the fast engine\n");
+        return runFast(entry);
+    }
+    unsigned int pc = entry;
+    int *R = RegisterFile;
+    long long count = 0;
+    for (;;) {
+        JitBlock block = JitCode[pc >> 2];
+        if (block == NULL && JitHeat[pc >> 2] < (unsigned int)config.jitThreshold
+            && ++JitHeat[pc >> 2] == (unsigned int)config.jitThreshold) {
+            block = JitCode[pc >> 2] = jitTranslate(pc);
+        }
+        if (block != NULL) {
+            pc = block(R, DataMemory, &JitNativeInstructions);
+        } else {
+            unsigned int func;
+            do {                                 /* interpret up to the end of the block */
+                func = *(unsigned int*)&InstructionMemory[pc] >> 26;
+                pc = fastStep(pc, R);
+                count++;
+            } while (func != BEQ && func != BNE && func != J && pc < 9999 && pc != 0);
+        }
+        if (pc >= 9999 || pc == 0) break;
+    }
+    PC = pc;
+    munmap(JitBuffer, JIT_BUFFER_BYTES);
+    return count + JitNativeInstructions;
+#else
+    printf("No JIT for this host, running the fast engine\n");
+    return runFast(entry);
+#endif
+}
+
+/**
+ * Host performance counters (--host-perf 1). Linux perf_event_open counters for the simulator process
+ * itself, so the cost of the interpreter can be broken down: host cycles and instructions (IPC), branch
+ * misses (dispatch), cache misses (memory) and task-clock (time on the CPU, which leaves out the time
+ * blocked on I/O). Each counter is opened on its own so a host without a PMU (most VMs) still gets the
+ * software ones.
+ *
+ * The totals cover the whole simulation loop, less the cost of the sampling below. The detailed engine also
+ * measures each stage of 1 in config.hostPerfSample instructions: the counters are read between fetch(),
+ * decode(), ... WB(), from user space with rdpmc when the kernel allows it and through read() otherwise, and
+ * the cost of a reading (calibrated at start up) is subtracted.
+ */
+#define NUM_HOST_COUNTERS 5
+#define NUM_STAGES 6
+
+struct HostCounter {
+    const char *name;
+    unsigned int type;
+    unsigned long long config;
+    int fd;                                   // -1 if the host does not have it
+#ifdef __linux__
+    struct perf_event_mmap_page *page;        // for rdpmc, NULL if user space reads are not allowed
+#endif
+    unsigned long long total;                 // over the simulation loop
+    double readCost;                          // counts added by one reading of all the counters
+    unsigned long long stage[NUM_STAGES];     // sampled per stage counts
+};
+
+struct HostCounter HostCounters[NUM_HOST_COUNTERS] = {
+#ifdef __linux__
+    { .name = "cycles", .type = PERF_TYPE_HARDWARE, .config = PERF_COUNT_HW_CPU_CYCLES, .fd = -1 },
+    { .name = "instructions", .type = PERF_TYPE_HARDWARE, .config = PERF_COUNT_HW_INSTRUCTIONS, .fd = -1 },
+    { .name = "branch-misses", .type = PERF_TYPE_HARDWARE, .config = PERF_COUNT_HW_BRANCH_MISSES, .fd = -1 },
+    { .name = "cache-misses", .type = PERF_TYPE_HARDWARE, .config = PERF_COUNT_HW_CACHE_MISSES, .fd = -1 },
+    { .name = "task-clock-ns", .type = PERF_TYPE_SOFTWARE, .config = PERF_COUNT_SW_TASK_CLOCK, .fd = -1 },
+#else
+    { .name = "cycles", .fd = -1 }, { .name = "instructions", .fd = -1 }, { .name = "branch-misses", .fd = -1 },
+    { .name = "cache-misses", .fd = -1 }, { .name = "task-clock-ns", .fd = -1 },
+#endif
+};
+const char *StageNames[NUM_STAGES] = { "fetch", "decode", "control", "EXE", "MEM", "WB" };
+unsigned long long NumStageSamples = 0;
+int HostPerfRdpmc = 0;                        // all the open counters can be read with rdpmc
+
+/* read one counter, rdpmc following the perf_event_mmap_page protocol or read() */
+unsigned long long readHostCounter(struct HostCounter *c) {
+#ifdef __linux__
+#if defined(__x86_64__) || defined(__i386__)
+    if (c->page != NULL) {
+        struct perf_event_mmap_page *pc = c->page;
+        unsigned int seq, index;
+        unsigned long long count;
+        do {
+            seq = pc->lock;
+            __sync_synchronize();
+            index = pc->cap_user_rdpmc ? pc->index : 0;
+            count = pc->offset;
+            if (index) {
+                unsigned long long pmc = __builtin_ia32_rdpmc(index - 1);
+                count += (unsigned long long)((long long)(pmc << (64 - pc->pmc_width)) >> (64 - pc->pmc_width));
+            }
+            __sync_synchronize();
+        } while (pc->lock != seq);
+        if (index) return count;
+        /* the event is not on the PMU right now (multiplexed or descheduled) or rdpmc is no longer allowed:
+         * offset alone is stale, the kernel has the count */
+    }
+#endif
+    unsigned long long value = 0;
+    if (read(c->fd, &value, sizeof(value)) != sizeof(value)) return 0;
+    return value;
+#else
+    (void)c;
+    return 0;
+#endif
+}
+
+void readHostCounters(unsigned long long *values) {
+    int e;
+    for (e = 0; e < NUM_HOST_COUNTERS; e++) {
+        if (HostCounters[e].fd >= 0) values[e] = readHostCounter(&HostCounters[e]);
+    }
+}
+
+/**
+ * Open the counters and calibrate the cost of a reading.
+ * @return the number of counters the host has
+ */
+int initHostPerf() {
+    int e, opened = 0;
+#ifdef __linux__
+    HostPerfRdpmc = 1;
+    for (e = 0; e < NUM_HOST_COUNTERS; e++) {
+        struct HostCounter *c = &HostCounters[e];
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = c->type;
+        attr.config = c->config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        c->fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (c->fd < 0) continue;
+        opened++;
+        c->page = NULL;
+        if (c->type == PERF_TYPE_HARDWARE) {
+            void *page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, c->fd, 0);
+            if (page != MAP_FAILED && ((struct perf_event_mmap_page*)page)->cap_user_rdpmc) {
+                c->page = (struct perf_event_mmap_page*)page;
+            } else if (page != MAP_FAILED) {
+                munmap(page, sysconf(_SC_PAGESIZE));
+            }
+        }
+        if (c->page == NULL) HostPerfRdpmc = 0;
+        ioctl(c->fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(c->fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    /* the cost of one reading of all the counters, the smallest of a few rounds */
+    unsigned long long before[NUM_HOST_COUNTERS] = {0}, after[NUM_HOST_COUNTERS] = {0};
+    int round, k;
+    for (e = 0; e < NUM_HOST_COUNTERS; e++) HostCounters[e].readCost = -1;
+    for (round = 0; round < 16; round++) {
+        readHostCounters(before);
+        for (k = 0; k < 16; k++) readHostCounters(after);
+        for (e = 0; e < NUM_HOST_COUNTERS; e++) {
+            double cost = (after[e] - before[e]) / 16.0;
+            if (HostCounters[e].readCost < 0 || cost < HostCounters[e].readCost) HostCounters[e].readCost = cost;
+        }
+    }
+#else
+    (void)e;
+#endif
+    return opened;
+}
+
+/* the counters run all the time, the totals are the difference between the two calls */
+void hostPerfStart() {
+    unsigned long long values[NUM_HOST_COUNTERS] = {0};
+    int e;
+    readHostCounters(values);
+    for (e = 0; e < NUM_HOST_COUNTERS; e++) HostCounters[e].total = values[e];
+}
+
+void hostPerfStop() {
+    unsigned long long values[NUM_HOST_COUNTERS] = {0};
+    int e;
+    readHostCounters(values);
+    for (e = 0; e < NUM_HOST_COUNTERS; e++) {
+        struct HostCounter *c = &HostCounters[e];
+        /* take out the readings of the per stage samples, NUM_STAGES + 1 per sample */
+        double sampling = (double)NumStageSamples*(NUM_STAGES + 1)*c->readCost;
+        c->total = values[e] - c->total;
+        c->total = c->total > sampling ? c->total - (unsigned long long)sampling : 0;
+    }
+}
+
+/**
+ * One instruction through the datapath, like the body of the runDetailed() loop, with the counters read
+ * between the stages.
+ */
+void hostPerfStep() {
+    unsigned long long values[NUM_STAGES + 1][NUM_HOST_COUNTERS] = {{0}};
+    int s, e;
+    DatapathLazy = 0;
+    readHostCounters(values[0]);
+    fetch();
+    readHostCounters(values[1]);
+    decode();
+    readHostCounters(values[2]);
+    controlAndRegisterFetch();
+    readHostCounters(values[3]);
+    EXE();
+    readHostCounters(values[4]);
+    MEM();
+    readHostCounters(values[5]);
+    WB();
+    readHostCounters(values[6]);
+    for (s = 0; s < NUM_STAGES; s++) {
+        for (e = 0; e < NUM_HOST_COUNTERS; e++) {
+            HostCounters[e].stage[s] += values[s + 1][e] - values[s][e];
+        }
+    }
+    NumStageSamples++;
+}
+
+void printHostPerfReport(long long IC) {
+    int e, s;
+    printf("Host performance counters, simulation loop of %lld instructions:\n", IC);
+    for (e = 0; e < NUM_HOST_COUNTERS; e++) {
+        struct HostCounter *c = &HostCounters[e];
+        if (c->fd < 0) {
+            printf("  %-14s not supported by this host\n", c->name);
+            continue;
+        }
+        printf("  %-14s %16llu  %10.2f per simulated instruction\n", c->name, c->total, IC ? (double)c->total/IC : 0.0);
+    }
+    if (HostCounters[0].fd >= 0 && HostCounters[1].fd >= 0 && HostCounters[0].total) {
+        printf("  host IPC %.2f\n", (double)HostCounters[1].total/HostCounters[0].total);
+    }
+    if (NumStageSamples == 0) return;
+    printf("Per stage, %llu sampled instructions (1 in %ld), read with %s, per instruction:\n",
+           NumStageSamples, config.hostPerfSample, HostPerfRdpmc ? "rdpmc" : "read()");
+    printf("  %-8s", "stage");
+    for (e = 0; e < NUM_HOST_COUNTERS; e++) if (HostCounters[e].fd >= 0) printf(" %14s", HostCounters[e].name);
+    printf("\n");
+    for (s = 0; s < NUM_STAGES; s++) {
+        printf("  %-8s", StageNames[s]);
+        for (e = 0; e < NUM_HOST_COUNTERS; e++) {
+            struct HostCounter *c = &HostCounters[e];
+            if (c->fd < 0) continue;
+            double perInstr = (double)c->stage[s]/NumStageSamples - c->readCost;
+            printf(" %14.2f", perInstr > 0 ? perInstr : 0.0);
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * Per-PC execution profile. One set of counters per static instruction, bumped from the simulation loop
+ * (no per-instruction trace is needed). At exit the hot spots are sorted and mapped back to the source
+ * lines through the <binFile>.map file written by the assembler.
+ */
+struct PCProfile {
+    unsigned long long exec;          // times the instruction was executed
+    unsigned long long icacheMiss;    // I-cache misses fetching it
+    unsigned long long dcacheMiss;    // D-cache misses of its LW/SW
+    unsigned long long taken;         // times it sent the PC somewhere other than PC+4 (taken branch or jump)
+} *Profile = NULL;
+int ProfileSize = 0;                  // number of static instructions profiled
+
+#define MAX_SOURCE_LINE 128
+struct SourceLine {
+    int lineNo;
+    char text[MAX_SOURCE_LINE];
+};
+
+/**
+ * Load the line map the assembler writes next to the binary: one "index lineNo source" line per instruction.
+ * @return array of numInstr entries, lineNo is 0 for instructions without a source line
+ */
+struct SourceLine *loadSourceMap(const char *binFileName, int numInstr) {
+    struct SourceLine *lines = (struct SourceLine*) calloc(numInstr, sizeof(struct SourceLine));
+    char mapFileName[strlen(binFileName)+8];
+    sprintf(mapFileName, "%s.map", binFileName);
+    FILE *mapFile = fopen(mapFileName, "r");
+    if (mapFile == NULL) return lines;
+    char buffer[1024];
+    while (fgets(buffer, sizeof(buffer), mapFile) != NULL) {
+        int index, lineNo, consumed;
+        if (sscanf(buffer, "%d %d %n", &index, &lineNo, &consumed) < 2 || index < 0 || index >= numInstr) continue;
+        char *text = buffer + consumed;
+        text[strcspn(text, "\r\n")] = '\0';
+        lines[index].lineNo = lineNo;
+        snprintf(lines[index].text, MAX_SOURCE_LINE, "%s", text);
+    }
+    fclose(mapFile);
+    return lines;
+}
+
+int compareProfileIndex(const void *a, const void *b) {
+    unsigned long long ea = Profile[*(const int*)a].exec, eb = Profile[*(const int*)b].exec;
+    if (ea != eb) return ea < eb ? 1 : -1;
+    return *(const int*)a - *(const int*)b;
+}
+
+/**
+ * Write the hot-spot report: instructions sorted by execution count, then the loops (the ranges closed by a
+ * taken backward branch or jump) with their share of the dynamic instruction count.
+ */
+void writeProfileReport(const char *fileName, const char *binFileName, long long IC) {
+    FILE *file = fopen(fileName, "w");
+    if (file == NULL) {
+        printf("Could not open profile file %s\n", fileName);
+        return;
+    }
+    struct SourceLine *lines = loadSourceMap(binFileName, ProfileSize);
+    int *order = (int*) malloc(ProfileSize*sizeof(int));
+    int i, n = 0;
+    for (i = 0; i < ProfileSize; i++) {
+        if (Profile[i].exec) order[n++] = i;
+    }
+    qsort(order, n, sizeof(int), compareProfileIndex);
+
+    fprintf(file, "Hot spots (%lld instructions executed)\n", IC);
+    fprintf(file, "%6s %6s %12s %7s %10s %10s %10s  %s\n", "PC", "line", "exec", "%IC", "I-miss", "D-miss", "taken", "source");
+    for (i = 0; i < n; i++) {
+        int k = order[i];
+        fprintf(file, "%6d %6d %12llu %6.2f%% %10llu %10llu %10llu  %s\n", k*4, lines[k].lineNo, Profile[k].exec,
+                100.0*Profile[k].exec/IC, Profile[k].icacheMiss, Profile[k].dcacheMiss, Profile[k].taken, lines[k].text);
+    }
+
+    fprintf(file, "\nLoops\n");
+    fprintf(file, "%6s %6s %12s %12s %7s %10s %10s\n", "head", "tail", "iterations", "instructions", "%IC", "I-miss", "D-miss");
+    for (i = 0; i < ProfileSize; i++) {
+        union InstructionWord instrWord = *(union InstructionWord *) &InstructionMemory[i*4];
+        int target;
+        if (instrWord.jType.func == J) target = instrWord.jType.Imm;
+        else if (instrWord.iType.func == BEQ || instrWord.iType.func == BNE) target = i + 1 + instrWord.iType.Imm;
+        else continue;
+        if (target > i || target < 0 || Profile[i].taken == 0) continue;
+        unsigned long long insts = 0, imiss = 0, dmiss = 0;
+        int k;
+        for (k = target; k <= i; k++) {
+            insts += Profile[k].exec;
+            imiss += Profile[k].icacheMiss;
+            dmiss += Profile[k].dcacheMiss;
+        }
+        fprintf(file, "%6d %6d %12llu %12llu %6.2f%% %10llu %10llu\n", target*4, i*4, Profile[i].taken, insts,
+                100.0*insts/IC, imiss, dmiss);
+    }
+    free(order);
+    free(lines);
+    fclose(file);
+}
+
+/**
+ * Median reuse distance bucket of a histogram, as the upper bound of the bucket
+ */
+unsigned long long medianReuseDistance(const unsigned long long *hist) {
+    unsigned long long total = 0, seen = 0;
+    int k;
+    for (k = 0; k < REUSE_BUCKETS; k++) total += hist[k];
+    if (total == 0) return 0;
+    for (k = 0; k < REUSE_BUCKETS; k++) {
+        seen += hist[k];
+        if (seen*2 >= total) break;
+    }
+    return 1ULL << k;
+}
+
+/**
+ * Classify and report each static load/store. A PC is constant-stride when at least 90% of its accesses
+ * repeat the previous non-zero stride, reused when most of its accesses hit a block that was touched within
+ * the last 1024 accesses (a small cache would catch them), and irregular otherwise.
+ */
+void writeMemoryProfileReport(const char *fileName, const char *binFileName) {
+    FILE *file = fopen(fileName, "w");
+    if (file == NULL) {
+        printf("Could not open memory profile file %s\n", fileName);
+        return;
+    }
+    struct SourceLine *lines = loadSourceMap(binFileName, MemPatternSize);
+    int i, k;
+    fprintf(file, "Memory access patterns (%llu accesses, %llu distinct %d-byte blocks)\n",
+            NumMemAccesses, BlockTableUsed, 1 << MEM_BLOCK_SHIFT);
+    fprintf(file, "%6s %6s %12s %12s %8s %8s %8s %12s %-14s %s\n", "PC", "line", "loads", "stores", "stride",
+            "%stride", "%reuse", "med-reuse", "class", "source");
+    for (i = 0; i < MemPatternSize; i++) {
+        struct AccessPattern *p = &MemPattern[i];
+        unsigned long long count = p->loads + p->stores;
+        if (count == 0) continue;
+        double strideRatio = count > 2 ? (double)p->sameStride/(count - 2) : 0;
+        unsigned long long nearReuse = 0;
+        for (k = 0; k <= 10; k++) nearReuse += p->reuseHist[k];  /* distances below 1024 */
+        const char *kind;
+        if (strideRatio >= 0.9 && p->lastStride != 0) kind = "constant-stride";
+        else if (nearReuse*2 > count) kind = "reused";
+        else kind = "irregular";
+        fprintf(file, "%6d %6d %12llu %12llu %8d %7.1f%% %7.1f%% %12llu %-14s %s\n", i*4, lines[i].lineNo,
+                p->loads, p->stores, p->lastStride, 100.0*strideRatio, 100.0*p->reused/count,
+                medianReuseDistance(p->reuseHist), kind, lines[i].text);
+    }
+
+    fprintf(file, "\nReuse distance histogram (accesses since the block was last touched)\n");
+    fprintf(file, "%12s %12s\n", "< distance", "accesses");
+    fprintf(file, "%12s %12llu\n", "cold", ColdAccesses);
+    for (k = 1; k < REUSE_BUCKETS; k++) {
+        if (ReuseHist[k]) fprintf(file, "%12llu %12llu\n", 1ULL << k, ReuseHist[k]);
+    }
+
+    fprintf(file, "\nWorking set per window of %ld accesses\n", config.memWindow);
+    fprintf(file, "%8s %10s %12s\n", "window", "blocks", "bytes");
+    unsigned long long w;
+    for (w = 0; w < NumWindows; w++) {
+        fprintf(file, "%8llu %10u %12llu\n", w, WindowBlocks[w], (unsigned long long)WindowBlocks[w] << MEM_BLOCK_SHIFT);
+    }
+    free(lines);
+    fclose(file);
+}
+
+/**
+ * Verification oracles. Each workload (the program being simulated plus the data it works on) registers
+ * an init function that sets up DataMemory/registers before the simulation and a verify function that
+ * checks the result afterwards. verify returns the number of wrong result elements and reports at most
+ * config.maxMismatches of them through reportMismatch().
+ */
+struct Workload {
+    const char *name;
+    const char *description;
+    void (*init)(void);
+    long (*verify)(void);
+};
+
+#define VERIFY_CHUNK 4096          // number of elements compared per chunk
+long NumMismatchReported = 0;
+
+void reportMismatch(const char *array, long index, int expected, int simulated) {
+    if (NumMismatchReported++ < config.maxMismatches) {
+        fprintf(cpusimTraceFile, "Verification failed: V%s[%ld]: %d, Sim Number: %d\n", array, index, expected, simulated);
+    }
+}
+
+/**
+ * Compare the simulated result with the reference for elements [from, to) and report the mismatches.
+ * The first pass only XORs the two arrays together chunk by chunk, which vectorizes and runs in parallel
+ * (when built with OpenMP); only the chunks that differ are walked again to report the mismatches, in order,
+ * so the report is the same however many threads are used.
+ * @return the number of mismatched elements
+ */
+long compareArrays(const char *array, const int *expected, const int *simulated, long from, long to) {
+    if (to <= from) return 0;
+    long numChunks = (to - from + VERIFY_CHUNK - 1) / VERIFY_CHUNK;
+    unsigned char *chunkDiffers = (unsigned char*) calloc(numChunks, 1);
+    long c;
+    #pragma omp parallel for schedule(static)
+    for (c = 0; c < numChunks; c++) {
+        long begin = from + c*VERIFY_CHUNK;
+        long end = begin + VERIFY_CHUNK < to ? begin + VERIFY_CHUNK : to;
+        unsigned int diff = 0;
+        long i;
+        for (i = begin; i < end; i++) diff |= (unsigned int)(expected[i] ^ simulated[i]);
+        chunkDiffers[c] = diff != 0;
+    }
+
+    long mismatches = 0;
+    for (c = 0; c < numChunks; c++) {
+        if (!chunkDiffers[c]) continue;
+        long begin = from + c*VERIFY_CHUNK;
+        long end = begin + VERIFY_CHUNK < to ? begin + VERIFY_CHUNK : to;
+        long i;
+        for (i = begin; i < end; i++) {
+            if (expected[i] != simulated[i]) {
+                reportMismatch(array, i, expected[i], simulated[i]);
+                mismatches++;
+            }
+        }
+    }
+    free(chunkDiffers);
+    return mismatches;
+}
+
+/* test.asm: A[i] = B[i-1] + B[i] + B[i+1] for i = 1 .. N-3 */
+void conv3Init() {
+    FillRandom((int*)(&DataMemory[config.BBase]), config.N, config.seed);
+}
+
+long conv3Verify() {
+    long N = config.N;
+    const int * A = (int*)(&DataMemory[config.ABase]);
+    const int * B = (int*)(&DataMemory[config.BBase]);
+    int * VA = (int*) malloc(N*sizeof(int));  /* on the heap, N can be far bigger than the stack */
+    long i;
+    #pragma omp parallel for schedule(static)
+    for (i = 1; i < N-2; i++) {
+        /* unsigned so the wrap around matches the simulated 32-bit adder */
+        VA[i] = (int)((unsigned int)B[i - 1] + (unsigned int)B[i] + (unsigned int)B[i + 1]);
+    }
+    long mismatches = compareArrays("A", VA, A, 1, N-2);
+    free(VA);
+    return mismatches;
+}
+
+/*
+ * The benchmark kernels in bench/ read N from $s4 (run them with --n N --reg 4=N), walk A and B with the
+ * register-indexed LWR/SWR and each stress a different part of the simulator.
+ */
+
+/* bench/stream.asm: A[i] = 3*B[i] for i = 0 .. N-1, a unit-stride stream */
+void streamInit() {
+    FillRandom((int*)(&DataMemory[config.BBase]), config.N, config.seed);
+}
+
+long streamVerify() {
+    long N = config.N;
+    const int * A = (int*)(&DataMemory[config.ABase]);
+    const int * B = (int*)(&DataMemory[config.BBase]);
+    int * VA = (int*) malloc(N*sizeof(int));
+    long i;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < N; i++) VA[i] = (int)((unsigned int)B[i] * 3u);
+    long mismatches = compareArrays("A", VA, A, 0, N);
+    free(VA);
+    return mismatches;
+}
+
+/* bench/stride.asm: A[i] = B[i]+1, column by column of B seen as rows of 16 words, so consecutive
+ * accesses are 64 bytes apart */
+long strideVerify() {
+    long N = config.N;
+    const int * A = (int*)(&DataMemory[config.ABase]);
+    const int * B = (int*)(&DataMemory[config.BBase]);
+    int * VA = (int*) malloc(N*sizeof(int));
+    long i;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < N; i++) VA[i] = (int)((unsigned int)B[i] + 1u);
+    long mismatches = compareArrays("A", VA, A, 0, N);
+    free(VA);
+    return mismatches;
+}
+
+/* bench/chase.asm: B is a random cyclic permutation of byte offsets, A[k] = p and p = B[p/4], starting
+ * from p = 0; every load depends on the one before and hits a random block */
+void chaseInit() {
+    long N = config.N;
+    int * B = (int*)(&DataMemory[config.BBase]);
+    int * random = (int*) malloc(N*sizeof(int));
+    long i;
+    FillRandom(random, N, config.seed);
+    for (i = 0; i < N; i++) B[i] = (int)i;
+    /* Sattolo's shuffle, the result is a single cycle through all N elements */
+    for (i = N - 1; i > 0; i--) {
+        long j = random[i] % i;
+        int t = B[i];
+        B[i] = B[j];
+        B[j] = t;
+    }
+    for (i = 0; i < N; i++) B[i] *= 4;
+    free(random);
+}
+
+long chaseVerify() {
+    long N = config.N;
+    const int * A = (int*)(&DataMemory[config.ABase]);
+    const int * B = (int*)(&DataMemory[config.BBase]);
+    int * VA = (int*) malloc(N*sizeof(int));
+    long k;
+    unsigned int p = 0;
+    for (k = 0; k < N; k++) {
+        VA[k] = (int)p;
+        p = (unsigned int)B[p/4];
+    }
+    long mismatches = compareArrays("A", VA, A, 0, N);
+    free(VA);
+    return mismatches;
+}
+
+/* bench/branch.asm: one Collatz step, A[i] = B[i] odd ? 3*B[i]+1 : B[i]/2, a data dependent branch
+ * that goes either way at random */
+long branchVerify() {
+    long N = config.N;
+    const int * A = (int*)(&DataMemory[config.ABase]);
+    const int * B = (int*)(&DataMemory[config.BBase]);
+    int * VA = (int*) malloc(N*sizeof(int));
+    long i;
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < N; i++) {
+        unsigned int b = (unsigned int)B[i];
+        VA[i] = (int)(b & 1 ? 3u*b + 1u : b >> 1);
+    }
+    long mismatches = compareArrays("A", VA, A, 0, N);
+    free(VA);
+    return mismatches;
+}
+
+struct Workload Workloads[] = {
+    {"conv3", "test.asm 3-point convolution, A[i] = B[i-1]+B[i]+B[i+1]", conv3Init, conv3Verify},
+    {"stream", "bench/stream.asm unit-stride stream, A[i] = 3*B[i]", streamInit, streamVerify},
+    {"stride", "bench/stride.asm 64-byte strided walk, A[i] = B[i]+1", streamInit, strideVerify},
+    {"chase", "bench/chase.asm pointer chase through a random cycle in B", chaseInit, chaseVerify},
+    {"branch", "bench/branch.asm data dependent branches, one Collatz step", streamInit, branchVerify},
+};
+#define NUM_WORKLOADS (sizeof(Workloads)/sizeof(Workloads[0]))
+
+struct Workload *findWorkload(const char *name) {
+    unsigned int w;
+    for (w = 0; w < NUM_WORKLOADS; w++) {
+        if (strcmp(Workloads[w].name, name) == 0) return &Workloads[w];
+    }
+    return NULL;
+}
+
+/**
+ * Append the record of the instruction just executed to the binary trace. The data accesses were collected
+ * by traceOutAccess() while it went through MEM().
+ */
+void writeTraceOutRecord(int iMissBefore) {
+    struct CTraceRecord *r = &TraceOutRecord;
+    materializeSignals();
+    r->pc = PC;
+    r->ir = IR;
+    r->flags = NumICacheMiss != iMissBefore ? CTR_IMISS : 0;
+    if (control.RegWrite == 1) {
+        r->flags |= CTR_REG_WRITE;
+        r->reg = datapath.RWselect;
+        r->value = datapath.RWvalue;
+    }
+    if (control.VRegWrite == 1) {
+        r->flags |= CTR_VREG_WRITE;
+        r->vreg = datapath.RWselect % NUM_VECTOR_REGISTERS;
+        memcpy(r->vvalue, VectorRegisterFile[r->vreg], sizeof(r->vvalue));
+    }
+    ctraceAppend(TraceOut, r);
+    r->numAccesses = 0;
+}
+
+/*
+ * Interval statistics (--stats <file>, detailed engine). Every config.statsInterval instructions, or modeled
+ * cycles with --stats-unit cycles, each core appends a CSV row with what it did in the interval, so the phases
+ * of a run (the caches warming up, the steady state of a loop, ...) show where the summary only has the
+ * averages of the whole run. The cores share the file, so --parallel 1 is not allowed with it. A row is due at
+ * the end of an instruction, its last row covers the rest of the run. With --stats-unit cycles an instruction
+ * may stall past the end of the interval, the interval then ends with it and the next one is counted from
+ * there, so no row but the last covers less than the interval. The rows of the cores come in the order their
+ * intervals end.
+ */
+#define STATS_HEADER "core,instructions,cycles,interval_instructions,interval_cycles,cpi,icache_hit_ratio," \
+                     "dcache_read_hit_ratio,dcache_write_hit_ratio,loads,stores,branches,taken_branches\n"
+
+struct IntervalStats {
+    int core;
+    unsigned long long instructions;     // executed by the core
+    unsigned long long next;             // instructions or cycle at which the current interval ends
+    unsigned long long startInstructions, startCycle;   // where the current interval started
+    int iHit, dRead, dReadHit, dWrite, dWriteHit;       // the cache counters there
+    unsigned long long branches, taken;  // in the current interval
+};
+
+FILE *StatsFile = NULL;
+CORE_LOCAL struct IntervalStats *Stats = NULL;   // of the core being simulated, NULL unless --stats
+
+static void writeStatsRow() {
+    struct IntervalStats *s = Stats;
+    unsigned long long cycle = Timing != NULL ? Timing->cycle : 0;
+    unsigned long long n = s->instructions - s->startInstructions, cycles = cycle - s->startCycle;
+    int reads = NumDCacheRead - s->dRead, writes = NumDCacheWrite - s->dWrite;
+    fprintf(StatsFile, "%d,%llu,%llu,%llu,%llu,%.3f,%.4f,%.4f,%.4f,%d,%d,%llu,%llu\n", s->core, s->instructions, cycle,
+            n, cycles, n ? ((double)cycles)/n : 0.0, n ? ((double)(NumICacheHit - s->iHit))/n : 0.0,
+            reads ? ((double)(NumDCacheReadHit - s->dReadHit))/reads : 0.0,
+            writes ? ((double)(NumDCacheWriteHit - s->dWriteHit))/writes : 0.0, reads, writes, s->branches, s->taken);
+    s->startInstructions = s->instructions;
+    s->startCycle = cycle;
+    s->iHit = NumICacheHit;
+    s->dRead = NumDCacheRead;
+    s->dReadHit = NumDCacheReadHit;
+    s->dWrite = NumDCacheWrite;
+    s->dWriteHit = NumDCacheWriteHit;
+    s->branches = s->taken = 0;
+}
+
+/* the end of an instruction, before PC moves on */
+static inline void sampleStats() {
+    unsigned int func = (unsigned int)IR >> 26;
+    Stats->instructions++;
+    if (func == BEQ || func == BNE || func == J) {
+        Stats->branches++;
+        Stats->taken += datapath.PCnext != PC + 4;
+    }
+    unsigned long long now = config.statsByCycles ? Timing->cycle : Stats->instructions;
+    if (now >= Stats->next) {
+        writeStatsRow();
+        Stats->next = now + config.statsInterval;
+    }
+}
+
+/**
+ * One instruction of the detailed engine, with the binary trace record and the profile counts
+ * @param IC the number of instructions executed before this one
+ * @param lazy execute it with lazyStep()
+ * @return 1 when the program has terminated
+ */
+static inline int detailedInstruction(long long IC, int lazy) {
+    int iMissBefore = NumICacheMiss, dMissBefore = NumDCacheMiss;
+    if (config.hostPerf && IC % config.hostPerfSample == 0) {
+        hostPerfStep();
+    } else if (lazy) {
+        lazyStep();
+    } else {
+        fetch();
+        decode();
+        controlAndRegisterFetch();
+        EXE();
+        MEM();
+        WB();
+    }
+    if (Timing != NULL) retireInstruction();
+    if (TraceOut != NULL) writeTraceOutRecord(iMissBefore);
+    if (Stats != NULL) sampleStats();
+
+    if (Profile != NULL && (unsigned int)PC < (unsigned int)ProfileSize*4) {
+        struct PCProfile *p = &Profile[PC >> 2];
+        p->exec++;
+        p->icacheMiss += NumICacheMiss - iMissBefore;
+        p->dcacheMiss += NumDCacheMiss - dMissBefore;
+        p->taken += datapath.PCnext != (int)datapath.PCplus4;
+    }
+
+    PC = datapath.PCnext;
+    if (PC >= 9999) return 1; // J <very far address> is just the easiest way to terminate the program
+    if (PC == 0) {//* goes to infinite loop for the test.asm program, we terminate */
+        TRACE("Simulation goes to infinits loop of test.asm program, terminate it\n");
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Multi-core (--cores n, detailed engine). Every core runs the program from the entry point with its own PC,
+ * RegisterFile, VectorRegisterFile and instruction and data caches; DataMemory is shared and the data caches
+ * are kept coherent with MESI (cachemodel.h). The cores execute one instruction each in turn, round robin,
+ * until all of them have terminated. A core finds its number in $s30 and the number of cores in $s31, which
+ * is how a kernel splits its range between them (bench/conv3mc.asm).
+ * The globals of the datapath (PC, RegisterFile, VectorRegisterFile, ICache, DCache and the cache counters)
+ * are those of the core being simulated, loadCore() and saveCore() switch them.
+ */
+struct Core {
+    int PC;
+    int *registers;
+    int vectorRegisters[NUM_VECTOR_REGISTERS][VECTOR_WORDS];
+    struct Cache *icache, *dcache;
+    struct CoreCaches caches;           // the caches of the cores after the first, which has InstructionCache and DataCache
+    long long IC;
+    int iHit, iMiss, dRead, dReadHit, dWrite, dWriteHit, dMiss;
+    int done;
+    pthread_t thread;                   // with --parallel, the cores after the first
+    struct StoreBuffer stores;          // with --parallel and --deterministic
+    struct CoreTiming timing;           // with --timing
+    struct IntervalStats stats;         // with --stats
+} *Cores = NULL;
+
+void loadCore(struct Core *core) {
+    PC = core->PC;
+    RegisterFile = core->registers;
+    VectorRegisterFile = core->vectorRegisters;
+    ICache = core->icache;
+    DCache = core->dcache;
+    Timing = config.timing ? &core->timing : NULL;
+    Stats = StatsFile != NULL ? &core->stats : NULL;
+    NumICacheHit = core->iHit;
+    NumICacheMiss = core->iMiss;
+    NumDCacheRead = core->dRead;
+    NumDCacheReadHit = core->dReadHit;
+    NumDCacheWrite = core->dWrite;
+    NumDCacheWriteHit = core->dWriteHit;
+    NumDCacheMiss = core->dMiss;
+}
+
+void saveCore(struct Core *core) {
+    core->PC = PC;
+    core->iHit = NumICacheHit;
+    core->iMiss = NumICacheMiss;
+    core->dRead = NumDCacheRead;
+    core->dReadHit = NumDCacheReadHit;
+    core->dWrite = NumDCacheWrite;
+    core->dWriteHit = NumDCacheWriteHit;
+    core->dMiss = NumDCacheMiss;
+}
+
+/**
+ * Give every core the registers set up for the workload, with its number in $s30 and the number of cores in
+ * $s31, and the cores after the first their own caches. With more than one core the data caches join the
+ * coherence bus. Core 0 is loaded.
+ */
+void initCores(int entry) {
+    int c;
+    Cores = (struct Core*) calloc(config.cores, sizeof(struct Core));
+    for (c = 0; c < config.cores; c++) {
+        struct Core *core = &Cores[c];
+        core->PC = entry;
+        if (c == 0) {
+            core->registers = RegisterFile;
+            core->icache = &InstructionCache;
+            core->dcache = &DataCache;
+        } else {
+            core->registers = (int*) malloc(32*sizeof(int));
+            memcpy(core->registers, RegisterFile, 32*sizeof(int));
+            initCoreCaches(&core->caches);
+            core->icache = &core->caches.icache;
+            core->dcache = &core->caches.dcache;
+        }
+        core->registers[30] = c;
+        core->registers[31] = config.cores;
+        core->stats.core = c;
+        core->stats.next = config.statsInterval;
+        if (config.cores > 1) attachToBus(core->dcache);
+    }
+    loadCore(&Cores[0]);
+}
+
+/**
+ * The last row of the interval statistics of every core, for the rest of the run
+ * @return 0 if the file could not be written
+ */
+int finishStats() {
+    int c;
+    for (c = 0; c < config.cores; c++) {
+        if (config.cores > 1) loadCore(&Cores[c]);
+        if (Stats->instructions > Stats->startInstructions) writeStatsRow();
+    }
+    return fclose(StatsFile) == 0;
+}
+
+/**
+ * After the run the cache counters are the totals of all the cores
+ */
+void finishCores() {
+    int c;
+    if (config.cores == 1) return;
+    NumICacheHit = NumICacheMiss = NumDCacheRead = NumDCacheReadHit = NumDCacheWrite = NumDCacheWriteHit = NumDCacheMiss = 0;
+    for (c = 0; c < config.cores; c++) {
+        struct Core *core = &Cores[c];
+        NumICacheHit += core->iHit;
+        NumICacheMiss += core->iMiss;
+        NumDCacheRead += core->dRead;
+        NumDCacheReadHit += core->dReadHit;
+        NumDCacheWrite += core->dWrite;
+        NumDCacheWriteHit += core->dWriteHit;
+        NumDCacheMiss += core->dMiss;
+        if (c > 0) finishCoreCaches(&core->caches);
+    }
+}
+
+/*
+ * Host-parallel multi-core (--parallel 1). Each core runs on its own host thread, core 0 on the main one, and
+ * the run proceeds in epochs: every core executes config.quantum instructions (fewer once it terminates),
+ * then all the threads meet at a barrier where one of them ends the epoch. In deterministic mode it writes the
+ * store buffers of the cores to DataMemory, then it puts the bus requests the data caches logged during the
+ * epoch on the bus (coherenceReplay()), both in the order of the instruction counts and then of the cores.
+ * Within an epoch the caches of a core only change through its own accesses and, in deterministic mode, a core
+ * only sees the stores the others made before the epoch, so the results do not depend on how the host
+ * schedules the threads. With --deterministic 0 the stores go straight to DataMemory, where the other cores
+ * may read them within the epoch: the threads then race on DataMemory as the cores of the program do, and a
+ * program whose cores share data may run differently every time. A shorter quantum brings the interleaving
+ * closer to the round robin of --parallel 0.
+ */
+pthread_barrier_t EpochBarrier;
+unsigned long long NumEpochs = 0;
+int AllCoresDone = 0;
+
+/**
+ * Write the store buffers of all the cores to DataMemory and empty them
+ */
+void drainStoreBuffers() {
+    int pos[MAX_CORES] = {0};
+    int c, i;
+    for (;;) {
+        unsigned long long key = ~0ULL;
+        for (c = 0; c < config.cores; c++) {
+            struct StoreBuffer *b = &Cores[c].stores;
+            if (pos[c] < b->count && b->stores[pos[c]].key < key) key = b->stores[pos[c]].key;
+        }
+        if (key == ~0ULL) break;
+        for (c = 0; c < config.cores; c++) {
+            struct StoreBuffer *b = &Cores[c].stores;
+            for (; pos[c] < b->count && b->stores[pos[c]].key == key; pos[c]++) {
+                WriteDataMemoryWord(b->stores[pos[c]].addr, b->stores[pos[c]].value);
+            }
+        }
+    }
+    for (c = 0; c < config.cores; c++) {
+        struct StoreBuffer *b = &Cores[c].stores;
+        for (i = 0; i < b->count; i++) *storeSlot(b, b->stores[i].addr) = 0;
+        b->count = 0;
+    }
+}
+
+/**
+ * The barrier at the end of an epoch
+ * @return 1 when every core has terminated
+ */
+int endEpoch() {
+    int c;
+    if (pthread_barrier_wait(&EpochBarrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+        if (config.deterministic) drainStoreBuffers();
+        coherenceReplay();
+        NumEpochs++;
+        AllCoresDone = 1;
+        for (c = 0; c < config.cores; c++) AllCoresDone &= Cores[c].done;
+    }
+    pthread_barrier_wait(&EpochBarrier);
+    return AllCoresDone;
+}
+
+/* the simulation loop of one core, on its host thread */
+void *coreThreadMain(void *arg) {
+    struct Core *core = (struct Core*) arg;
+    int lazy = LazyDatapath;   // there is no trace
+    long n;
+    loadCore(core);
+    if (config.deterministic) CoreStores = &core->stores;
+    do {
+        for (n = 0; n < config.quantum && !core->done; n++) {
+            DCache->busKey = core->IC;
+            core->done = detailedInstruction(core->IC++, lazy);
+        }
+    } while (!endEpoch());
+    saveCore(core);
+    return NULL;
+}
+
+/**
+ * The detailed engine with each core on its own host thread
+ * @return the number of instructions executed by all the cores
+ */
+long long runParallel() {
+    long long IC = 0;
+    int c;
+    Bus.deferred = 1;
+    pthread_barrier_init(&EpochBarrier, NULL, config.cores);
+    for (c = 1; c < config.cores; c++) {
+        if (pthread_create(&Cores[c].thread, NULL, coreThreadMain, &Cores[c]) != 0) {
+            printf("Could not start the host thread of core %d\n", c);
+            exit(1);
+        }
+    }
+    coreThreadMain(&Cores[0]);
+    for (c = 1; c < config.cores; c++) pthread_join(Cores[c].thread, NULL);
+    pthread_barrier_destroy(&EpochBarrier);
+    Bus.deferred = 0;
+    for (c = 0; c < config.cores; c++) IC += Cores[c].IC;
+    return IC;
+}
+
+/**
+ * The cycles of the run are those of the core that took longest, the CPI is over all the cores
+ */
+void printTimingSummary(FILE *file) {
+    unsigned long long cycles = 0, allCycles = 0, fetchStalls = 0, loadUseStalls = 0, missStalls = 0, tlbStalls = 0;
+    long long IC = 0;
+    int c;
+    for (c = 0; c < config.cores; c++) {
+        struct CoreTiming *t = &Cores[c].timing;
+        if (t->cycle > cycles) cycles = t->cycle;
+        allCycles += t->cycle;
+        fetchStalls += t->fetchStalls;
+        loadUseStalls += t->loadUseStalls;
+        missStalls += t->missStalls;
+        tlbStalls += t->tlbStalls;
+        IC += Cores[c].IC;
+    }
+    fprintf(file, "\t Timing (in-order, %d MSHRs, %d-cycle memory): Cycles: %llu, CPI: %.2f, Stall Cycles: Instruction Fetch: %llu, Load Use: %llu, Data Cache: %llu, Data TLB: %llu\n",
+            DMSHR.numEntries, DMSHR.latency, cycles, IC ? ((double)allCycles)/IC : 0.0, fetchStalls, loadUseStalls, missStalls,
+            tlbStalls);
+    for (c = 0; config.cores > 1 && c < config.cores; c++) {
+        fprintf(file, "\t Core %d: Cycles: %llu, CPI: %.2f\n", c, Cores[c].timing.cycle,
+                Cores[c].IC ? ((double)Cores[c].timing.cycle)/Cores[c].IC : 0.0);
+    }
+}
+
+void printCoreSummary(FILE *file) {
+    long long longest = 0;
+    int c;
+    for (c = 0; c < config.cores; c++) {
+        struct Core *core = &Cores[c];
+        if (core->IC > longest) longest = core->IC;
+        fprintf(file, "\t Core %d: Instructions Executed: %lld, ICache Hit Ratio: %.2f, DCache Reads: %d, Hit Ratio: %.2f, DCache Writes: %d, Hit Ratio: %.2f\n",
+                c, core->IC, core->IC ? ((float)core->iHit)/core->IC : 0.0f, core->dRead,
+                core->dRead ? ((float)core->dReadHit)/core->dRead : 0.0f, core->dWrite,
+                core->dWrite ? ((float)core->dWriteHit)/core->dWrite : 0.0f);
+    }
+    fprintf(file, "\t Cores: %d, Instructions of the longest running core: %lld\n", config.cores, longest);
+    if (config.parallel) {
+        fprintf(file, "\t Parallel: %d host threads, %llu epochs of %ld instructions per core, %s\n", config.cores,
+                NumEpochs, config.quantum, config.deterministic ? "deterministic" : "not deterministic");
+    }
+}
+
+/**
+ * The detailed engine: the CPU simulation loop, each iteration executes one instruction through the
+ * datapath and the caches, of each core in turn when there are several.
+ * @return the number of instructions executed
+ */
+long long runDetailed() {
+    long long IC = 0;
+    int lazy = LazyDatapath && !TraceEnabled;   // the trace prints every signal
+    int c, running = config.cores;
+    if (config.cores > 1 && config.parallel) return runParallel();
+    if (config.cores == 1) {
+        while (!detailedInstruction(IC++, lazy));
+        Cores[0].IC = IC;
+        return IC;
+    }
+    while (running > 0) {
+        for (c = 0; c < config.cores; c++) {
+            struct Core *core = &Cores[c];
+            if (core->done) continue;
+            loadCore(core);
+            TRACE("Core %d\n", c);
+            core->done = detailedInstruction(IC++, lazy);
+            core->IC++;
+            saveCore(core);
+            running -= core->done;
+        }
+    }
+    return IC;
 }
 
+void usage() {
+    printf("Usage: cpusim <fileName> [options]\n"
+           "  --config <file>     read options from a file, one \"key value\" per line\n"
+           "  --engine <name>     detailed (datapath, caches and trace), fast (functional only) or jit (fast, with\n"
+           "                      hot blocks translated to x86-64) (default detailed)\n"
+           "  --jit-threshold <n> entries of a block before the jit engine translates it (default 16)\n"
+           "  --cores <n>         cores running the program, with MESI-coherent data caches (detailed engine,\n"
+           "                      default 1); $s30 holds the number of the core and $s31 the number of cores\n"
+           "  --parallel <0|1>    run each core on its own host thread instead of round robin on one (default 0,\n"
+           "                      needs --trace 0)\n"
+           "  --quantum <n>       instructions each core runs between two barriers with --parallel 1 (default 1000)\n"
+           "  --deterministic <0|1> with --parallel 1, the other cores see the stores of a core at the next barrier\n"
+           "                      only, so runs are repeatable (default 1)\n"
+           "  --timing <0|1>      count cycles: an in-order core with a register scoreboard and a non-blocking\n"
+           "                      data cache (detailed engine, default 0)\n"
+           "  --mshrs <n>         MSHRs of the data cache with --timing 1, 0 makes it blocking (default 8, max 64)\n"
+           "  --mem-latency <n>   cycles from a cache miss to its block arriving from memory, only the instruction\n"
+           "                      cache misses with --dram (default 100)\n"
+           "  --trace <0|1>       write the per-instruction trace to cpusim_trace.txt (default 1)\n"
+           "  --trace-async <0|1> format and write the trace on a separate thread (default 1)\n"
+           "  --lazy-datapath <0|1> with the trace off, the detailed engine sets only the datapath signals that\n"
+           "                      are needed to execute, the others when something reads them (default 1)\n"
+           "  --trace-out <file>  write a compressed, seekable binary trace to file, read it with tracereader\n"
+           "  --trace-chunk <n>   instructions per chunk of the binary trace (default 65536)\n"
+           "  --bbv <file>        write the basic block vector of every interval to file, SimPoint format, for\n"
+           "                      the simpoint tool (fast engine)\n"
+           "  --bbv-interval <n>  instructions per interval of --bbv (default 100000)\n"
+           "  --stats <file>      write the hit ratios, loads, stores, branches and, with --timing 1, the CPI of\n"
+           "                      every interval of the run to file as CSV, one row per interval and core\n"
+           "                      (detailed engine, not with --parallel 1)\n"
+           "  --stats-interval <n> length of the intervals of --stats (default 100000)\n"
+           "  --stats-unit <instructions|cycles> what --stats-interval counts, cycles need --timing 1\n"
+           "                      (default instructions)\n"
+           "  --host-perf <0|1>   report host cycles, IPC, branch and cache misses of the simulation loop (default 0)\n"
+           "  --host-perf-sample <n> measure fetch..WB of 1 in n instructions of the detailed engine (default 64)\n"
+           "  --seed <n|time>     seed for initializing B (default 1)\n"
+           "  --n <n>             number of elements in A and B (default 256)\n"
+           "  --a-base <addr>     byte address of A in data memory, put in $s1 (default 0)\n"
+           "  --b-base <addr>     byte address of B in data memory, put in $s2 (default right after A)\n"
+           "  --reg <r>=<value>   initial value of register r, may be repeated\n"
+           "  --mem <addr>=<value> initial value of the data memory word at addr, may be repeated\n"
+           "  --workload <name>   workload used for init and verification (default conv3)\n"
+           "  --max-mismatches <n> report at most n verification failures (default 10)\n"
+           "  --profile <file>    collect a per-PC profile and write the hot-spot report to file (detailed engine)\n"
+           "  --mem-profile <file> analyze LW/SW strides, reuse and working set, write the report to file\n"
+           "                      (detailed engine)\n"
+           "  --mem-window <n>    memory accesses per working-set window (default 4096)\n");
+    printCacheOptions();
+    printDRAMOptions();
+    printMMUOptions();
+    printf("Workloads:\n");
+    unsigned int w;
+    for (w = 0; w < NUM_WORKLOADS; w++) printf("  %-19s %s\n", Workloads[w].name, Workloads[w].description);
+}
 
 int main(int argc, char *argv[]) {
-    /* fileName should be provided as the first parameter of the program */
-    if (argc != 2) {
-        printf("Usage: cpusim <fileName>\n");
+    /* fileName should be provided as the first parameter of the program, followed by the options */
+    if (argc < 2 || argv[1][0] == '-') {
+        usage();
+        return 1;
+    }
+    int arg;
+    for (arg = 2; arg < argc; arg++) {
+        if (strncmp(argv[arg], "--", 2) != 0 || arg + 1 == argc) {
+            usage();
+            return 1;
+        }
+        const char *key = argv[arg] + 2;
+        const char *value = argv[++arg];
+        if (strcmp(key, "config") == 0) {
+            if (!readConfigFile(value)) return 1;
+        } else if (!setConfigOption(key, value)) {
+            printf("Invalid option --%s %s\n", key, value);
+            usage();
+            return 1;
+        }
+    }
+    unsigned long long arrayBytes = config.N*4ULL;
+    if (!config.BBaseSet && config.ABase + arrayBytes <= DATA_MEMORY_SIZE) config.BBase = config.ABase + arrayBytes;
+    if (config.ABase + arrayBytes > DATA_MEMORY_SIZE || config.BBase + arrayBytes > DATA_MEMORY_SIZE) {
+        printf("A and B (%d elements each) do not fit in the %d-byte data memory\n", config.N, DATA_MEMORY_SIZE);
+        return 1;
+    }
+
+    struct Workload *workload = findWorkload(config.workload);
+    if (workload == NULL) {
+        printf("Unknown workload %s\n", config.workload);
+        usage();
         return 1;
     }
 
     /* initialize the CPU components, mainly the IM, DM, PC, registers, etc */
-    InstructionMemory = (char*) malloc(1024*1024); /* 1Kbyes */
-    DataMemory = (char*) malloc(1024*1024*1024); /* 1Mbyes */
-    RegisterFile = (int*) malloc(32*4); /* 32 32-bit registers */
+    InstructionMemory = (char*) calloc(1024*1024, 1); /* 1Mbytes */
+    DataMemory = (char*) calloc(DATA_MEMORY_SIZE, 1); /* 1Gbytes */
+    RegisterFile = (int*) calloc(32, 4); /* 32 32-bit registers, all start as 0 so runs are reproducible */
     RegisterFile[0] = 0; //$s0 is 0
 
+    initCaches(InstructionMemory, 1024*1024, DataMemory, DATA_MEMORY_SIZE);
+
     // Load the binary file into instruction memory
     FILE *binFile = fopen(argv[1], "r");
     if (binFile == NULL){
@@ -530,65 +3367,185 @@ int main(int argc, char *argv[]) {
     int programEntry = 0;
     datapath.PC=programEntry;
 
-    /* init memory and register for test.asm program
-     * A and B each array has 256 int elements. We only need to init B.
+    /* init memory and register for the workload
+     * A and B each array has N int elements, the workload initializes its inputs.
      * The base addresses of A and B are stored in register $s1 and $s2
      */
-    int N = 256;
-    RegisterFile[1] = 0;    /* memory address for A, A is in DataMemory starting from 0 for N*4 bytes */
-    RegisterFile[2] = N*4;  /* memory address for B, B is in DataMemory starting from N*4 for N*4 bytes
-                             * B can start from any address within the range as long as it does not overlap with A.
-                             */
-    //manually initialize B
+    RegisterFile[1] = config.ABase;  /* memory address for A, A is in DataMemory starting from ABase for N*4 bytes */
+    RegisterFile[2] = config.BBase;  /* memory address for B, B is in DataMemory starting from BBase for N*4 bytes
+                                      * B can start from any address within the range as long as it does not overlap with A.
+                                      */
+    workload->init();
+
     int i;
-    int * A = (int*)(&DataMemory[RegisterFile[1]]);
-    int * B = (int*)(&DataMemory[RegisterFile[2]]);
-    srand(time(NULL));
-    for (i=0; i<N; i++) B[i] = rand();
-
-    /* CPU simulation loop, each iteration executes one instruction */
-    int IC = 0;
-    for(;;) {
-        fetch();
-        decode();
-        controlAndRegisterFetch();
-        EXE();
-        MEM();
-        WB();
+    /* explicit register and memory contents from the command line or config file */
+    for (i = 0; i < config.numRegInit; i++) {
+        if (config.regInit[i].reg != 0) RegisterFile[config.regInit[i].reg] = config.regInit[i].value;
+    }
+    for (i = 0; i < config.numMemInit; i++) {
+        WriteDataMemoryWord(config.memInit[i].addr, config.memInit[i].value);
+    }
 
-        PC = datapath.PCnext;
-        IC++;
-        if (PC >= 9999) break; // J <very far address> is just the easiest way to terminate the program
-        if (PC == 0) {//* goes to infinite loop for the test.asm program, we terminate */
-            fprintf(cpusimTraceFile, "Simulation goes to infinits loop of test.asm program, terminate it\n");
-            break;
+    if (config.cores > 1 && (config.engine != ENGINE_DETAILED || config.traceOut[0])) {
+        printf("--cores needs the detailed engine and no --trace-out\n");
+        return 1;
+    }
+    if (config.timing && config.engine != ENGINE_DETAILED) {
+        printf("--timing needs the detailed engine\n");
+        return 1;
+    }
+    if (config.timing) DataCache.mshr = &DMSHR;
+    if (Dram.enabled) {
+        if (!config.timing || (config.cores > 1 && config.parallel)) {
+            printf("--dram needs --timing 1 and no --parallel, the cores share it\n");
+            return 1;
+        }
+        if (!initDRAM(&Dram, DataCache.blockBytes)) {
+            printf("--dram rows must hold a whole data cache block\n");
+            return 1;
+        }
+        DMSHR.dram = &Dram;
+    }
+    if (DMMU.enabled) {
+        if (config.engine != ENGINE_DETAILED) {
+            printf("--mmu needs the detailed engine\n");
+            return 1;
+        }
+        initMMU(&DMMU, DATA_MEMORY_SIZE);
+        DataCache.mmu = &DMMU;
+    }
+    if (config.cores > 1 && config.parallel && (TraceEnabled || config.profile[0] || config.memProfile[0] || config.hostPerf
+                                                || config.stats[0])) {
+        printf("--parallel needs --trace 0 and no --profile, --mem-profile, --host-perf or --stats\n");
+        return 1;
+    }
+    if (config.stats[0]) {
+        if (config.engine != ENGINE_DETAILED || (config.statsByCycles && !config.timing)) {
+            printf("--stats needs the detailed engine, and --timing 1 with --stats-unit cycles\n");
+            return 1;
+        }
+        StatsFile = fopen(config.stats, "w");
+        if (StatsFile == NULL) {
+            printf("Could not open file %s\n", config.stats);
+            return 1;
+        }
+        fputs(STATS_HEADER, StatsFile);
+    }
+    if ((config.profile[0] || config.memProfile[0]) && config.engine != ENGINE_DETAILED) {
+        printf("--profile and --mem-profile need the detailed engine\n");
+        return 1;
+    }
+    initCores(programEntry);
+
+    if (config.profile[0]) {
+        ProfileSize = numInstr;
+        Profile = (struct PCProfile*) calloc(numInstr, sizeof(struct PCProfile));
+    }
+    if (config.memProfile[0]) initMemoryProfiler(numInstr, config.memWindow);
+
+    if (config.hostPerf && initHostPerf() == 0) {
+        printf("No host performance counters available, --host-perf ignored\n");
+        config.hostPerf = 0;
+    }
+
+    if (config.bbv[0]) {
+        if (config.engine != ENGINE_FAST) {
+            printf("--bbv needs the fast engine\n");
+            return 1;
+        }
+        BBVFile = fopen(config.bbv, "w");
+        if (BBVFile == NULL) {
+            printf("Could not open file %s\n", config.bbv);
+            return 1;
         }
     }
 
-    /* verification of the simulation with our own computation of test.asm */
-    int VA[N];
-    int success = 1;
-    for (i=1; i != N-2; i++) {
-        VA[i] = B[i - 1] + B[i] + B[i + 1];
-        if (A[i] != VA[i]) {
-            fprintf(cpusimTraceFile, "Verification failed: VA[%d]: %d, Sim Number: %d\n", i, VA[i], A[i]);
-            success = 0;
+    if (config.traceOut[0]) {
+        if (config.engine != ENGINE_DETAILED) {
+            printf("--trace-out needs the detailed engine\n");
+            return 1;
+        }
+        TraceOut = ctraceCreate(config.traceOut, (unsigned int)config.traceChunk);
+        if (TraceOut == NULL) {
+            printf("Could not open file %s\n", config.traceOut);
+            return 1;
         }
     }
+
+    /* CPU simulation loop */
+    struct timespec simStart, simEnd;
+    clock_gettime(CLOCK_MONOTONIC, &simStart);
+    if (TraceEnabled && config.traceAsync && config.engine == ENGINE_DETAILED) startTraceWriter();
+    if (config.hostPerf) hostPerfStart();
+    long long IC = config.engine == ENGINE_FAST ? (BBVFile != NULL ? runFastBBV(programEntry, BBVFile) : runFast(programEntry))
+                 : config.engine == ENGINE_JIT ? runJit(programEntry) : runDetailed();
+    if (config.hostPerf) hostPerfStop();
+    stopTraceWriter();
+    clock_gettime(CLOCK_MONOTONIC, &simEnd);
+    double simSeconds = (simEnd.tv_sec - simStart.tv_sec) + (simEnd.tv_nsec - simStart.tv_nsec)*1e-9;
+
+    if (StatsFile != NULL && !finishStats()) printf("Could not write file %s\n", config.stats);
+    finishCores();
+    finishCaches();
+
+    /* verification of the simulation with the workload's own computation */
+    long mismatches = workload->verify();
+    int success = mismatches == 0;
     if (success) {
         printf("Simulation and Verification Passed Successfully!\n");
         fprintf(cpusimTraceFile, "===================================================\n");
         fprintf(cpusimTraceFile, "Simulation and Verification Passed Successfully!\n");
         fprintf(cpusimTraceFile, "Simulation Summary: \n");
-        fprintf(cpusimTraceFile, "\t Num of Instructions Executed: %d, %d Instructions Hit in Cache, Hit Ratio: %.2f\n",
-                IC, NumICacheHit, ((float)NumICacheHit)/((float)IC));
-        fprintf(cpusimTraceFile, "\t LW Instruction Executed (MEM Read): %d, DataCacheReadHit: %d, Hit Ratio: %.2f\n",
-                NumDCacheRead, NumDCacheReadHit, ((float)NumDCacheReadHit)/((float)NumDCacheRead));
-        fprintf(cpusimTraceFile, "\t SW Instruction Executed (MEM Write): %d, DataCacheWriteHit: %d, Hit Ratio: %.2f\n",
-                NumDCacheWrite, NumDCacheWriteHit, ((float)NumDCacheWriteHit)/((float)NumDCacheWrite));
+        if (config.engine != ENGINE_DETAILED) {
+            fprintf(cpusimTraceFile, "\t Num of Instructions Executed: %lld (%s engine, no cache model)\n", IC,
+                    config.engine == ENGINE_JIT ? "jit" : "fast");
+        } else {
+            fprintf(cpusimTraceFile, "\t Num of Instructions Executed: %lld, %d Instructions Hit in Cache, Hit Ratio: %.2f\n",
+                    IC, NumICacheHit, ((float)NumICacheHit)/((float)IC));
+            fprintf(cpusimTraceFile, "\t LW Instruction Executed (MEM Read): %d, DataCacheReadHit: %d, Hit Ratio: %.2f\n",
+                    NumDCacheRead, NumDCacheReadHit, ((float)NumDCacheReadHit)/((float)NumDCacheRead));
+            fprintf(cpusimTraceFile, "\t SW Instruction Executed (MEM Write): %d, DataCacheWriteHit: %d, Hit Ratio: %.2f\n",
+                    NumDCacheWrite, NumDCacheWriteHit, ((float)NumDCacheWriteHit)/((float)NumDCacheWrite));
+            if (config.timing) printTimingSummary(cpusimTraceFile);
+            if (config.cores > 1) printCoreSummary(cpusimTraceFile);
+            printCacheSummary(cpusimTraceFile);
+        }
     } else {
-        printf("Verification Failed!\n");
+        printf("Verification Failed! %ld mismatches\n", mismatches);
+        if (mismatches > config.maxMismatches) {
+            fprintf(cpusimTraceFile, "... %ld more verification failures not reported\n", mismatches - config.maxMismatches);
+        }
+    }
+
+    /* host speed of the simulation loop alone, the benchmark harness (bench/cpusim_bench.c) parses this line */
+    printf("Executed %lld instructions in %.6f seconds, %.2f MIPS\n", IC, simSeconds,
+           simSeconds > 0 ? IC/simSeconds/1e6 : 0.0);
+    if (config.hostPerf) printHostPerfReport(IC);
+    if (BBVFile != NULL) {
+        if (fclose(BBVFile) != 0) printf("Could not write file %s\n", config.bbv);
+        else printf("Basic block vectors: %llu intervals of %ld instructions, %u blocks, written to %s\n",
+                    BBVIntervals, config.bbvInterval, BBVNumBlocks, config.bbv);
+    }
+    if (config.engine == ENGINE_JIT) {
+        printf("JIT: %llu blocks translated, %lld of the instructions (%.1f%%) executed in native code\n",
+               JitBlocks, JitNativeInstructions, IC ? 100.0*JitNativeInstructions/IC : 0.0);
+    }
+
+    if (TraceOut != NULL) {
+        unsigned long long chunks = TraceOut->numChunks + (TraceOut->rawInstrs != 0);
+        if (!ctraceClose(TraceOut)) {
+            printf("Could not write file %s\n", config.traceOut);
+            return 1;
+        }
+        FILE *f = fopen(config.traceOut, "rb");
+        fseek(f, 0, SEEK_END);
+        long bytes = ftell(f);
+        fclose(f);
+        printf("Binary trace %s: %lld instructions in %llu chunks, %ld bytes, %.2f bytes/instruction\n",
+               config.traceOut, IC, chunks, bytes, IC ? (double)bytes/IC : 0.0);
     }
+    if (Profile != NULL) writeProfileReport(config.profile, argv[1], IC);
+    if (MemPattern != NULL) writeMemoryProfileReport(config.memProfile, argv[1]);
 
     fclose(cpusimTraceFile);
 
@@ -0,0 +1,308 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "cputrace.h"
+
+/* compressed binary trace, the format is described in cputrace.h */
+
+char *FuncNames[64] = {
+    "ADD", "SUB", "LWR", "MUL", "AND", "ADDI", "OR", "XOR", "LW", "SW", "SLT", "SWR", "BEQ", "BNE", NULL, "J",
+    "SLL", "SRL", NULL, NULL, "VLW", "VSW", "VADD",
+};
+
+static void putVarint(unsigned char **p, unsigned long long v) {
+    while (v >= 0x80) {
+        *(*p)++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *(*p)++ = (unsigned char)v;
+}
+
+static unsigned long long getVarint(const unsigned char **p) {
+    unsigned long long v = 0;
+    int shift = 0;
+    while (**p & 0x80) {
+        v |= (unsigned long long)(*(*p)++ & 0x7F) << shift;
+        shift += 7;
+    }
+    return v | (unsigned long long)(*(*p)++) << shift;
+}
+
+/* 32-bit deltas, so that they wrap the same way as the simulated registers */
+static unsigned int zigzag(unsigned int delta) {
+    return (delta << 1) ^ (unsigned int)((int)delta >> 31);
+}
+
+static unsigned int unzigzag(unsigned int v) {
+    return (v >> 1) ^ (0u - (v & 1));
+}
+
+struct CTraceWriter *ctraceCreate(const char *fileName, unsigned int chunkInstrs) {
+    FILE *file = fopen(fileName, "wb");
+    if (file == NULL) return NULL;
+    struct CTraceWriter *w = (struct CTraceWriter*) calloc(1, sizeof(struct CTraceWriter));
+    w->file = file;
+    w->chunkInstrs = chunkInstrs;
+    w->raw[CTRACE_ADDRESS_STREAM] = (unsigned char*) malloc((size_t)chunkInstrs*CTR_MAX_ADDRESS_BYTES);
+    w->raw[CTRACE_VALUE_STREAM] = (unsigned char*) malloc((size_t)chunkInstrs*CTR_MAX_VALUE_BYTES);
+#ifdef HAVE_ZLIB
+    w->storedCapacity = compressBound((uLong)chunkInstrs*CTR_MAX_ADDRESS_BYTES);  /* the larger of the streams */
+    w->stored = (unsigned char*) malloc(w->storedCapacity);
+#endif
+    fwrite(CTRACE_MAGIC, 1, 8, file);
+    return w;
+}
+
+/**
+ * Write one stream of the chunk, deflated when built with zlib
+ * @return the number of bytes written
+ */
+static unsigned int writeStream(struct CTraceWriter *w, int stream) {
+    const unsigned char *data = w->raw[stream];
+    unsigned int bytes = w->rawBytes[stream];
+#ifdef HAVE_ZLIB
+    uLongf storedBytes = w->storedCapacity;
+    if (compress2(w->stored, &storedBytes, data, bytes, Z_BEST_SPEED) != Z_OK) w->error = 1;
+    data = w->stored;
+    bytes = (unsigned int)storedBytes;
+#endif
+    fwrite(data, 1, bytes, w->file);
+    return bytes;
+}
+
+static void flushChunk(struct CTraceWriter *w) {
+    if (w->rawInstrs == 0) return;
+    struct CTraceChunkHeader header;
+    int stream;
+    long headerOffset = ftell(w->file);
+    header.firstInstr = w->numInstr - w->rawInstrs;
+    header.numInstr = w->rawInstrs;
+#ifdef HAVE_ZLIB
+    header.codec = CTRACE_CODEC_ZLIB;
+#else
+    header.codec = CTRACE_CODEC_STORED;
+#endif
+    fwrite(&header, sizeof(header), 1, w->file);      /* again below, once the sizes are known */
+    for (stream = 0; stream < CTRACE_STREAMS; stream++) {
+        header.rawBytes[stream] = w->rawBytes[stream];
+        header.storedBytes[stream] = writeStream(w, stream);
+        w->rawTotal += w->rawBytes[stream];
+        w->storedTotal += header.storedBytes[stream];
+        w->rawBytes[stream] = 0;
+    }
+    long end = ftell(w->file);
+    fseek(w->file, headerOffset, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, w->file);
+    fseek(w->file, end, SEEK_SET);
+
+    if (w->numChunks == w->indexCapacity) {
+        w->indexCapacity = w->indexCapacity ? w->indexCapacity*2 : 256;
+        w->index = (struct CTraceIndexEntry*) realloc(w->index, w->indexCapacity*sizeof(struct CTraceIndexEntry));
+    }
+    w->index[w->numChunks].firstInstr = header.firstInstr;
+    w->index[w->numChunks].offset = (unsigned long long)headerOffset;
+    w->numChunks++;
+    w->rawInstrs = 0;
+    memset(&w->state, 0, sizeof(w->state));
+}
+
+void ctraceAppend(struct CTraceWriter *w, const struct CTraceRecord *record) {
+    unsigned char *p = w->raw[CTRACE_ADDRESS_STREAM] + w->rawBytes[CTRACE_ADDRESS_STREAM];
+    struct CTraceState *s = &w->state;
+    int numAccesses = record->numAccesses < CTR_MAX_ACCESSES ? record->numAccesses : CTR_MAX_ACCESSES;
+    int a, k;
+    *p++ = (unsigned char)(record->flags | numAccesses << 4);
+    putVarint(&p, zigzag(record->pc - (s->pc + 4)));
+    s->pc = record->pc;
+    for (a = 0; a < numAccesses; a++) {
+        *p++ = record->access[a].kind;
+        putVarint(&p, zigzag(record->access[a].addr - s->dataAddr));
+        s->dataAddr = record->access[a].addr;
+    }
+    w->rawBytes[CTRACE_ADDRESS_STREAM] = (unsigned int)(p - w->raw[CTRACE_ADDRESS_STREAM]);
+
+    p = w->raw[CTRACE_VALUE_STREAM] + w->rawBytes[CTRACE_VALUE_STREAM];
+    for (k = 0; k < 4; k++) *p++ = (unsigned char)(record->ir >> (8*k));
+    if (record->flags & CTR_REG_WRITE) {
+        *p++ = (unsigned char)(record->reg & 31);
+        putVarint(&p, zigzag((unsigned int)record->value - (unsigned int)s->reg[record->reg & 31]));
+        s->reg[record->reg & 31] = record->value;
+    }
+    if (record->flags & CTR_VREG_WRITE) {
+        int *v = s->vreg[record->vreg & 7];
+        *p++ = (unsigned char)(record->vreg & 7);
+        for (k = 0; k < CTR_VECTOR_WORDS; k++) {
+            putVarint(&p, zigzag((unsigned int)record->vvalue[k] - (unsigned int)v[k]));
+            v[k] = record->vvalue[k];
+        }
+    }
+    w->rawBytes[CTRACE_VALUE_STREAM] = (unsigned int)(p - w->raw[CTRACE_VALUE_STREAM]);
+    w->rawInstrs++;
+    w->numInstr++;
+    if (w->rawInstrs == w->chunkInstrs) flushChunk(w);
+}
+
+/**
+ * Write the last chunk, the index and the footer.
+ * @return 1 on success, 0 if a write failed
+ */
+int ctraceClose(struct CTraceWriter *w) {
+    flushChunk(w);
+    struct CTraceFooter footer;
+    footer.numChunks = w->numChunks;
+    footer.numInstr = w->numInstr;
+    footer.indexOffset = (unsigned long long)ftell(w->file);
+    memcpy(footer.magic, CTRACE_INDEX_MAGIC, 8);
+    fwrite(w->index, sizeof(struct CTraceIndexEntry), w->numChunks, w->file);
+    fwrite(&footer, sizeof(footer), 1, w->file);
+    int ok = !ferror(w->file) && !w->error;
+    ok &= fclose(w->file) == 0;
+    free(w->raw[CTRACE_ADDRESS_STREAM]);
+    free(w->raw[CTRACE_VALUE_STREAM]);
+    free(w->stored);
+    free(w->index);
+    free(w);
+    return ok;
+}
+
+/**
+ * Open a trace for reading, positioned at its first instruction.
+ * @param addressesOnly only the PCs, flags and data accesses are decoded, which spares inflating the value stream
+ * @return NULL if the file cannot be read or is not a trace
+ */
+struct CTraceReader *ctraceOpen(const char *fileName, int addressesOnly) {
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL) return NULL;
+    struct CTraceReader *r = (struct CTraceReader*) calloc(1, sizeof(struct CTraceReader));
+    char magic[8];
+    r->file = file;
+    r->addressesOnly = addressesOnly;
+    if (fread(magic, 1, 8, file) != 8 || memcmp(magic, CTRACE_MAGIC, 8) != 0
+        || fseek(file, -(long)sizeof(struct CTraceFooter), SEEK_END) != 0
+        || fread(&r->footer, sizeof(r->footer), 1, file) != 1 || memcmp(r->footer.magic, CTRACE_INDEX_MAGIC, 8) != 0) {
+        ctraceCloseReader(r);
+        return NULL;
+    }
+    r->index = (struct CTraceIndexEntry*) malloc((r->footer.numChunks + 1)*sizeof(struct CTraceIndexEntry));
+    if (fseek(file, (long)r->footer.indexOffset, SEEK_SET) != 0
+        || fread(r->index, sizeof(struct CTraceIndexEntry), r->footer.numChunks, file) != r->footer.numChunks) {
+        ctraceCloseReader(r);
+        return NULL;
+    }
+    r->chunkNumber = (unsigned long long)-1;
+    ctraceSeek(r, 0);
+    return r;
+}
+
+/* read one stream of the current chunk into r->raw[stream] */
+static int readStream(struct CTraceReader *r, int stream) {
+    unsigned int rawBytes = r->chunk.rawBytes[stream], storedBytes = r->chunk.storedBytes[stream];
+    if (rawBytes > r->rawCapacity[stream]) {
+        r->rawCapacity[stream] = rawBytes;
+        r->raw[stream] = (unsigned char*) realloc(r->raw[stream], rawBytes);
+    }
+    if (r->chunk.codec == CTRACE_CODEC_STORED) {
+        return storedBytes == rawBytes && fread(r->raw[stream], 1, rawBytes, r->file) == rawBytes;
+    }
+#ifdef HAVE_ZLIB
+    if (storedBytes > r->storedCapacity) {
+        r->storedCapacity = storedBytes;
+        r->stored = (unsigned char*) realloc(r->stored, storedBytes);
+    }
+    uLongf bytes = rawBytes;
+    return fread(r->stored, 1, storedBytes, r->file) == storedBytes
+        && uncompress(r->raw[stream], &bytes, r->stored, storedBytes) == Z_OK && bytes == rawBytes;
+#else
+    return 0; /* a zlib chunk and no zlib */
+#endif
+}
+
+/* read and decompress chunk c, @return 1 on success */
+static int loadChunk(struct CTraceReader *r, unsigned long long c) {
+    if (c >= r->footer.numChunks || fseek(r->file, (long)r->index[c].offset, SEEK_SET) != 0
+        || fread(&r->chunk, sizeof(r->chunk), 1, r->file) != 1) return 0;
+    if (!readStream(r, CTRACE_ADDRESS_STREAM)) return 0;
+    if (!r->addressesOnly && !readStream(r, CTRACE_VALUE_STREAM)) return 0;
+    r->chunkNumber = c;
+    r->rawPos[CTRACE_ADDRESS_STREAM] = r->rawPos[CTRACE_VALUE_STREAM] = r->chunkPos = 0;
+    memset(&r->state, 0, sizeof(r->state));
+    return 1;
+}
+
+/**
+ * Position the reader so that the next ctraceNext() returns instruction instr. Only the chunk holding it is
+ * decompressed, and decoded from its start.
+ * @return 1 on success, 0 if instr is past the end of the trace or the file is damaged
+ */
+int ctraceSeek(struct CTraceReader *r, unsigned long long instr) {
+    if (instr >= r->footer.numInstr) return 0;
+    unsigned long long lo = 0, hi = r->footer.numChunks;
+    while (hi - lo > 1) {                 /* the last chunk whose first instruction is <= instr */
+        unsigned long long mid = (lo + hi)/2;
+        if (r->index[mid].firstInstr <= instr) lo = mid; else hi = mid;
+    }
+    if (!loadChunk(r, lo)) return 0;
+    struct CTraceRecord skipped;
+    while (r->chunk.firstInstr + r->chunkPos < instr) ctraceNext(r, &skipped);
+    return 1;
+}
+
+/**
+ * Decode the next record.
+ * @return 1 if there was one, 0 at the end of the trace
+ */
+int ctraceNext(struct CTraceReader *r, struct CTraceRecord *record) {
+    if (r->chunkNumber >= r->footer.numChunks) return 0;
+    if (r->chunkPos == r->chunk.numInstr && !loadChunk(r, r->chunkNumber + 1)) return 0;
+    const unsigned char *p = r->raw[CTRACE_ADDRESS_STREAM] + r->rawPos[CTRACE_ADDRESS_STREAM];
+    struct CTraceState *s = &r->state;
+    int a, k;
+    record->index = r->chunk.firstInstr + r->chunkPos;
+    record->flags = *p & 0x0F;
+    record->numAccesses = *p++ >> 4;
+    s->pc += 4 + unzigzag((unsigned int)getVarint(&p));
+    record->pc = s->pc;
+    for (a = 0; a < record->numAccesses; a++) {
+        record->access[a].kind = *p++;
+        s->dataAddr += unzigzag((unsigned int)getVarint(&p));
+        record->access[a].addr = s->dataAddr;
+    }
+    r->rawPos[CTRACE_ADDRESS_STREAM] = (unsigned int)(p - r->raw[CTRACE_ADDRESS_STREAM]);
+    r->chunkPos++;
+    if (r->addressesOnly) {
+        record->ir = 0;
+        record->flags &= ~(CTR_REG_WRITE | CTR_VREG_WRITE);
+        return 1;
+    }
+
+    p = r->raw[CTRACE_VALUE_STREAM] + r->rawPos[CTRACE_VALUE_STREAM];
+    record->ir = p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+    p += 4;
+    if (record->flags & CTR_REG_WRITE) {
+        record->reg = *p++ & 31;
+        s->reg[record->reg] = (int)((unsigned int)s->reg[record->reg] + unzigzag((unsigned int)getVarint(&p)));
+        record->value = s->reg[record->reg];
+    }
+    if (record->flags & CTR_VREG_WRITE) {
+        record->vreg = *p++ & 7;
+        for (k = 0; k < CTR_VECTOR_WORDS; k++) {
+            s->vreg[record->vreg][k] = (int)((unsigned int)s->vreg[record->vreg][k] + unzigzag((unsigned int)getVarint(&p)));
+            record->vvalue[k] = s->vreg[record->vreg][k];
+        }
+    }
+    r->rawPos[CTRACE_VALUE_STREAM] = (unsigned int)(p - r->raw[CTRACE_VALUE_STREAM]);
+    return 1;
+}
+
+void ctraceCloseReader(struct CTraceReader *r) {
+    if (r == NULL) return;
+    fclose(r->file);
+    free(r->index);
+    free(r->raw[CTRACE_ADDRESS_STREAM]);
+    free(r->raw[CTRACE_VALUE_STREAM]);
+    free(r->stored);
+    free(r);
+}
@@ -0,0 +1,145 @@
+#ifndef CPUTRACE_H
+#define CPUTRACE_H
+
+#include <stdio.h>
+
+/*
+ * Compressed binary trace, written by cpusim_cachesim --trace-out <file> and read by tracereader.
+ *
+ * One record per executed instruction: its PC and instruction word, whether the instruction cache missed,
+ * the register it wrote and every data cache access it made. The records are grouped into chunks of a fixed
+ * number of instructions. Within a chunk PCs, register values and data addresses are stored as zigzag varint
+ * deltas against the previous ones, the delta state starts from zero in every chunk so a chunk decodes on its
+ * own. A chunk holds two streams, deflated separately (zlib, when built with HAVE_ZLIB, stored as is
+ * otherwise): the address stream with the PCs and data accesses, all that a cache replay (cachesim) needs,
+ * and the value stream with the instruction words and register values, which such a reader never inflates.
+ *
+ * File layout:
+ *   "CPUTRC2\0"
+ *   chunk header + address stream + value stream, repeated
+ *   index: one CTraceIndexEntry per chunk
+ *   CTraceFooter (at the very end, so a reader finds the index with one seek)
+ *
+ * Record layout, before compression, in the address stream:
+ *   flags             CTR_* bits, the number of data accesses in the high nibble
+ *   pc                zigzag varint of pc - (previous pc + 4)
+ *   [kind, addr]*     per data access: CTR_ACCESS_* bits, zigzag varint of addr - previous data address
+ * and in the value stream:
+ *   ir                4 bytes, little endian
+ *   [reg, value]      CTR_REG_WRITE: 1 byte, zigzag varint of value - previous value of that register
+ *   [vreg, 4 values]  CTR_VREG_WRITE: 1 byte, 4 zigzag varints against the previous vector register value
+ */
+
+#define CTRACE_MAGIC "CPUTRC2"
+#define CTRACE_INDEX_MAGIC "CPUTIDX"
+#define CTRACE_CODEC_STORED 0
+#define CTRACE_CODEC_ZLIB 1
+
+#define CTR_IMISS 0x01                    // the instruction cache missed
+#define CTR_REG_WRITE 0x02                // a scalar register was written
+#define CTR_VREG_WRITE 0x04               // a vector register was written
+#define CTR_MAX_ACCESSES 15               // data cache accesses per instruction, the high nibble of flags
+#define CTR_VECTOR_WORDS 4
+
+#define CTR_ACCESS_WRITE 0x01
+#define CTR_ACCESS_MISS 0x02              // not a hit in the cache or in a stream buffer
+
+#define CTRACE_ADDRESS_STREAM 0
+#define CTRACE_VALUE_STREAM 1
+#define CTRACE_STREAMS 2
+
+/* largest record in each stream */
+#define CTR_MAX_ADDRESS_BYTES (1 + 5 + 6*CTR_MAX_ACCESSES)
+#define CTR_MAX_VALUE_BYTES (4 + 6 + 1 + 5*CTR_VECTOR_WORDS)
+
+struct CTraceAccess {
+    unsigned int addr;
+    unsigned char kind;                   // CTR_ACCESS_* bits
+};
+
+struct CTraceRecord {
+    unsigned long long index;             // instruction number, from 0
+    unsigned int pc;
+    unsigned int ir;
+    int flags;                            // CTR_IMISS, CTR_REG_WRITE, CTR_VREG_WRITE
+    int reg;
+    int value;
+    int vreg;
+    int vvalue[CTR_VECTOR_WORDS];
+    int numAccesses;
+    struct CTraceAccess access[CTR_MAX_ACCESSES];
+};
+
+struct CTraceChunkHeader {
+    unsigned long long firstInstr;        // index of the first record
+    unsigned int numInstr;
+    unsigned int codec;                   // CTRACE_CODEC_*
+    unsigned int rawBytes[CTRACE_STREAMS];    // size of the records in each stream
+    unsigned int storedBytes[CTRACE_STREAMS]; // size of each stream in the file, in CTRACE_*_STREAM order
+};
+
+struct CTraceIndexEntry {
+    unsigned long long firstInstr;
+    unsigned long long offset;            // file offset of the chunk header
+};
+
+struct CTraceFooter {
+    unsigned long long numChunks;
+    unsigned long long numInstr;
+    unsigned long long indexOffset;
+    char magic[8];
+};
+
+/* the delta state, reset at the start of every chunk */
+struct CTraceState {
+    unsigned int pc;
+    unsigned int dataAddr;
+    int reg[32];
+    int vreg[8][CTR_VECTOR_WORDS];
+};
+
+struct CTraceWriter {
+    FILE *file;
+    unsigned int chunkInstrs;             // records per chunk
+    unsigned long long numInstr;
+    struct CTraceState state;
+    unsigned char *raw[CTRACE_STREAMS];   // records of the chunk being filled
+    unsigned int rawBytes[CTRACE_STREAMS];
+    unsigned int rawInstrs;
+    unsigned char *stored;                // compression output
+    unsigned long storedCapacity;
+    struct CTraceIndexEntry *index;
+    unsigned long long numChunks, indexCapacity;
+    unsigned long long rawTotal, storedTotal;
+    int error;                            // compression failed
+};
+
+struct CTraceReader {
+    FILE *file;
+    int addressesOnly;                    // the value stream is skipped, records have no ir or register values
+    struct CTraceFooter footer;
+    struct CTraceIndexEntry *index;
+    struct CTraceChunkHeader chunk;       // the chunk being decoded
+    unsigned long long chunkNumber;
+    unsigned char *raw[CTRACE_STREAMS];
+    unsigned long rawCapacity[CTRACE_STREAMS];
+    unsigned char *stored;
+    unsigned long storedCapacity;
+    unsigned int rawPos[CTRACE_STREAMS];  // byte position of the next record in each stream
+    unsigned int chunkPos;                // record position within the chunk
+    struct CTraceState state;
+};
+
+/* mnemonic of each function code, the top 6 bits of ir, NULL where no instruction uses the code */
+extern char *FuncNames[64];
+
+struct CTraceWriter *ctraceCreate(const char *fileName, unsigned int chunkInstrs);
+void ctraceAppend(struct CTraceWriter *w, const struct CTraceRecord *record);
+int ctraceClose(struct CTraceWriter *w);
+
+struct CTraceReader *ctraceOpen(const char *fileName, int addressesOnly);
+int ctraceSeek(struct CTraceReader *r, unsigned long long instr);
+int ctraceNext(struct CTraceReader *r, struct CTraceRecord *record);
+void ctraceCloseReader(struct CTraceReader *r);
+
+#endif
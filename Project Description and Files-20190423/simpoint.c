@@ -0,0 +1,342 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/*
+ * Phase analysis of a long run after SimPoint. Clusters the basic block vectors written by
+ * cpusim_cachesim --bbv, one per interval of instructions, and picks one interval to stand for each cluster.
+ * Each vector is normalized to the share of the interval's instructions spent in each block and randomly
+ * projected down to --dims dimensions. k-means then clusters the intervals for k = 1..--max-k, the best of
+ * KMEANS_TRIES seeds for each k. The Bayesian information criterion (BIC) scores each clustering, and the
+ * smallest k scoring at least 90% of the way from the worst score to the best is chosen. The simulation point
+ * of a cluster is the interval nearest to its centroid. Its weight is the share of the run's instructions in
+ * the cluster's intervals, so the short final interval counts for only the instructions it holds.
+ * Simulating those intervals in detail and weighting their results estimates the whole run.
+ *
+ * Build:   the simpoint target of the CMake build
+ * Example: build/cpusim_cachesim bench/conv3.asm.bin --n 262144 --reg 4=262144 --engine fast --bbv conv3.bb
+ *          build/simpoint conv3.bb --max-k 10 --out conv3
+ *          (writes conv3.simpoints and conv3.weights in the SimPoint formats)
+ */
+
+#define KMEANS_TRIES 5
+#define KMEANS_MAX_ITERATIONS 100
+#define BIC_THRESHOLD 0.9
+
+struct BBVSet {
+    int numIntervals;
+    int dims;
+    int numBlocks;                        // highest block number seen
+    double *point;                        // [numIntervals][dims] projected vectors
+    unsigned long long *instructions;     // [numIntervals] instructions in each interval
+};
+
+/* splitmix64, the random projection and the k-means seeds are the same on every platform */
+static unsigned long long nextRandom(unsigned long long *state) {
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static double uniform(unsigned long long *state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* the entry of the projection matrix for a block and a dimension, in [-1, 1) */
+static double projection(unsigned long long seed, unsigned int block, int dim) {
+    unsigned long long state = seed ^ ((unsigned long long)block << 20) ^ (unsigned long long)dim;
+    return 2.0*uniform(&state) - 1.0;
+}
+
+/**
+ * Read the vectors, one "T:<block>:<count> :<block>:<count> ..." line per interval
+ * @return 0 if the file cannot be read or holds no interval
+ */
+int readBBVs(const char *fileName, int dims, unsigned long long seed, struct BBVSet *set) {
+    FILE *file = fopen(fileName, "r");
+    if (file == NULL) return 0;
+    int capacity = 1024, c, d;
+    set->numIntervals = 0;
+    set->dims = dims;
+    set->numBlocks = 0;
+    set->point = (double*) malloc((size_t)capacity*dims*sizeof(double));
+    set->instructions = (unsigned long long*) malloc(capacity*sizeof(unsigned long long));
+    double *counts = (double*) malloc(sizeof(double));
+    unsigned int *blocks = (unsigned int*) malloc(sizeof(unsigned int));
+    int countCapacity = 1;
+    while ((c = fgetc(file)) != EOF) {
+        if (c != 'T') {                   /* a comment or an empty line */
+            while (c != '\n' && c != EOF) c = fgetc(file);
+            continue;
+        }
+        if (set->numIntervals == capacity) {
+            capacity *= 2;
+            set->point = (double*) realloc(set->point, (size_t)capacity*dims*sizeof(double));
+            set->instructions = (unsigned long long*) realloc(set->instructions, capacity*sizeof(unsigned long long));
+        }
+        unsigned int block;
+        unsigned long long count, total = 0;
+        int n = 0;
+        while (fscanf(file, " :%u:%llu", &block, &count) == 2) {
+            if (n == countCapacity) {
+                countCapacity *= 2;
+                counts = (double*) realloc(counts, countCapacity*sizeof(double));
+                blocks = (unsigned int*) realloc(blocks, countCapacity*sizeof(unsigned int));
+            }
+            blocks[n] = block;
+            counts[n++] = (double)count;
+            total += count;
+            if ((int)block > set->numBlocks) set->numBlocks = (int)block;
+        }
+        double *point = &set->point[(size_t)set->numIntervals*dims];
+        for (d = 0; d < dims; d++) point[d] = 0.0;
+        for (c = 0; c < n; c++) {
+            for (d = 0; d < dims; d++) point[d] += counts[c]/(total ? total : 1)*projection(seed, blocks[c], d);
+        }
+        set->instructions[set->numIntervals++] = total;
+    }
+    free(counts);
+    free(blocks);
+    fclose(file);
+    return set->numIntervals > 0;
+}
+
+static double distance2(const double *a, const double *b, int dims) {
+    double sum = 0.0;
+    int d;
+    for (d = 0; d < dims; d++) sum += (a[d] - b[d])*(a[d] - b[d]);
+    return sum;
+}
+
+/**
+ * k-means from a k-means++ seeding
+ * @param assign  set to the cluster of each interval
+ * @param centers set to the centroids, [k][dims]
+ * @return the sum of the squared distances of the intervals to their centroids
+ */
+double kmeans(const struct BBVSet *set, int k, unsigned long long seed, int *assign, double *centers) {
+    int R = set->numIntervals, M = set->dims, i, j, d, iteration;
+    double *nearest = (double*) malloc(R*sizeof(double));
+    int *members = (int*) malloc(k*sizeof(int));
+    unsigned long long state = seed;
+    memcpy(centers, &set->point[(size_t)(nextRandom(&state) % R)*M], M*sizeof(double));
+    for (i = 0; i < R; i++) nearest[i] = distance2(&set->point[(size_t)i*M], centers, M);
+    for (j = 1; j < k; j++) {             /* the next center is drawn with probability proportional to distance^2 */
+        double sum = 0.0, target;
+        for (i = 0; i < R; i++) sum += nearest[i];
+        target = uniform(&state)*sum;
+        for (i = 0; i < R - 1 && (target -= nearest[i]) > 0.0; i++);
+        memcpy(&centers[(size_t)j*M], &set->point[(size_t)i*M], M*sizeof(double));
+        for (i = 0; i < R; i++) {
+            double d2 = distance2(&set->point[(size_t)i*M], &centers[(size_t)j*M], M);
+            if (d2 < nearest[i]) nearest[i] = d2;
+        }
+    }
+    for (i = 0; i < R; i++) assign[i] = -1;
+    double distortion = 0.0;
+    for (iteration = 0; iteration < KMEANS_MAX_ITERATIONS; iteration++) {
+        int changed = 0, farthest = 0;
+        distortion = 0.0;
+        for (i = 0; i < R; i++) {
+            const double *p = &set->point[(size_t)i*M];
+            int best = 0;
+            double bestD2 = distance2(p, centers, M);
+            for (j = 1; j < k; j++) {
+                double d2 = distance2(p, &centers[(size_t)j*M], M);
+                if (d2 < bestD2) {
+                    bestD2 = d2;
+                    best = j;
+                }
+            }
+            changed |= assign[i] != best;
+            assign[i] = best;
+            nearest[i] = bestD2;
+            distortion += bestD2;
+            if (bestD2 > nearest[farthest]) farthest = i;
+        }
+        if (!changed) break;
+        memset(centers, 0, (size_t)k*M*sizeof(double));
+        memset(members, 0, k*sizeof(int));
+        for (i = 0; i < R; i++) {
+            members[assign[i]]++;
+            for (d = 0; d < M; d++) centers[(size_t)assign[i]*M + d] += set->point[(size_t)i*M + d];
+        }
+        for (j = 0; j < k; j++) {
+            if (members[j] == 0) {        /* an empty cluster takes over the interval farthest from its own */
+                memcpy(&centers[(size_t)j*M], &set->point[(size_t)farthest*M], M*sizeof(double));
+                nearest[farthest] = 0.0;
+                continue;
+            }
+            for (d = 0; d < M; d++) centers[(size_t)j*M + d] /= members[j];
+        }
+    }
+    free(nearest);
+    free(members);
+    return distortion;
+}
+
+/**
+ * BIC of a clustering, the log likelihood of the intervals under spherical Gaussians around the centroids
+ * (X-means, Pelleg and Moore) minus half the number of parameters times log R
+ */
+double bic(const struct BBVSet *set, int k, const int *assign, double distortion) {
+    int R = set->numIntervals, M = set->dims, i, j;
+    if (R <= k) return -HUGE_VAL;
+    double variance = distortion/((double)M*(R - k));
+    if (variance < 1e-12) variance = 1e-12;
+    int *members = (int*) calloc(k, sizeof(int));
+    for (i = 0; i < R; i++) members[assign[i]]++;
+    double logLikelihood = -R*log((double)R) - 0.5*R*M*log(2.0*M_PI*variance) - 0.5*M*(R - k);
+    for (j = 0; j < k; j++) {
+        if (members[j] > 0) logLikelihood += members[j]*log((double)members[j]);
+    }
+    free(members);
+    double parameters = (k - 1) + (double)M*k + 1;
+    return logLikelihood - 0.5*parameters*log((double)R);
+}
+
+void usage() {
+    printf("Usage: simpoint <bbv file> [options]\n"
+           "  --max-k <n>         try k = 1..n clusters (default 10)\n"
+           "  --dims <n>          dimensions of the random projection (default 15)\n"
+           "  --seed <n>          seed of the projection and of k-means (default 1)\n"
+           "  --out <prefix>      also write prefix.simpoints and prefix.weights in the SimPoint formats\n");
+}
+
+int main(int argc, char *argv[]) {
+    int maxK = 10, dims = 15;
+    unsigned long long seed = 1;
+    const char *out = NULL;
+    if (argc < 2 || argv[1][0] == '-') {
+        usage();
+        return 1;
+    }
+    int arg;
+    for (arg = 2; arg < argc; arg++) {
+        char *end;
+        if (strncmp(argv[arg], "--", 2) != 0 || arg + 1 == argc) {
+            usage();
+            return 1;
+        }
+        const char *key = argv[arg] + 2;
+        const char *value = argv[++arg];
+        int ok;
+        if (strcmp(key, "max-k") == 0) {
+            maxK = (int)strtol(value, &end, 0);
+            ok = end != value && *end == '\0' && maxK > 0;
+        } else if (strcmp(key, "dims") == 0) {
+            dims = (int)strtol(value, &end, 0);
+            ok = end != value && *end == '\0' && dims > 0;
+        } else if (strcmp(key, "seed") == 0) {
+            seed = strtoull(value, &end, 0);
+            ok = end != value && *end == '\0';
+        } else if (strcmp(key, "out") == 0) {
+            out = value;
+            ok = 1;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            printf("Invalid option --%s %s\n", key, value);
+            usage();
+            return 1;
+        }
+    }
+
+    struct BBVSet set;
+    if (!readBBVs(argv[1], dims, seed, &set)) {
+        printf("Could not read basic block vectors from %s\n", argv[1]);
+        return 1;
+    }
+    int R = set.numIntervals, k, t, i, j;
+    if (maxK > R) maxK = R;
+    printf("%s: %d intervals, %d blocks, projected to %d dimensions\n", argv[1], R, set.numBlocks, dims);
+
+    /* the best of the tries for every k */
+    int *assign = (int*) malloc((size_t)maxK*R*sizeof(int)), *tryAssign = (int*) malloc(R*sizeof(int));
+    double *centers = (double*) malloc((size_t)maxK*maxK*dims*sizeof(double));
+    double *tryCenters = (double*) malloc((size_t)maxK*dims*sizeof(double));
+    double *score = (double*) malloc(maxK*sizeof(double)), best = -HUGE_VAL, worst = HUGE_VAL;
+    unsigned long long state = seed;
+    for (k = 1; k <= maxK; k++) {
+        double bestDistortion = HUGE_VAL;
+        for (t = 0; t < KMEANS_TRIES; t++) {
+            double distortion = kmeans(&set, k, nextRandom(&state), tryAssign, tryCenters);
+            if (distortion < bestDistortion) {
+                bestDistortion = distortion;
+                memcpy(&assign[(size_t)(k - 1)*R], tryAssign, R*sizeof(int));
+                memcpy(&centers[(size_t)(k - 1)*maxK*dims], tryCenters, (size_t)k*dims*sizeof(double));
+            }
+        }
+        score[k - 1] = bic(&set, k, &assign[(size_t)(k - 1)*R], bestDistortion);
+        if (score[k - 1] == -HUGE_VAL) continue;
+        if (score[k - 1] > best) best = score[k - 1];
+        if (score[k - 1] < worst) worst = score[k - 1];
+    }
+    int chosen = 1;
+    for (k = 1; k <= maxK; k++) {
+        if (score[k - 1] == -HUGE_VAL) printf("  k = %2d  BIC: -\n", k);
+        else printf("  k = %2d  BIC: %.1f\n", k, score[k - 1]);
+    }
+    for (k = maxK; k >= 1; k--) {
+        if (score[k - 1] != -HUGE_VAL && score[k - 1] >= worst + BIC_THRESHOLD*(best - worst)) chosen = k;
+    }
+
+    /* the interval nearest to each centroid */
+    const int *a = &assign[(size_t)(chosen - 1)*R];
+    const double *c = &centers[(size_t)(chosen - 1)*maxK*dims];
+    int *point = (int*) malloc(chosen*sizeof(int)), *members = (int*) calloc(chosen, sizeof(int));
+    unsigned long long *first = (unsigned long long*) malloc(R*sizeof(unsigned long long)), instructions = 0;
+    unsigned long long *clusterInstructions = (unsigned long long*) calloc(chosen, sizeof(unsigned long long));
+    for (i = 0; i < R; i++) {
+        first[i] = instructions;
+        instructions += set.instructions[i];
+    }
+    for (j = 0; j < chosen; j++) point[j] = -1;
+    for (i = 0; i < R; i++) {
+        j = a[i];
+        members[j]++;
+        clusterInstructions[j] += set.instructions[i];
+        if (point[j] < 0 || distance2(&set.point[(size_t)i*dims], &c[(size_t)j*dims], dims) <
+                            distance2(&set.point[(size_t)point[j]*dims], &c[(size_t)j*dims], dims)) point[j] = i;
+    }
+    printf("Chosen k = %d, %llu instructions in all\n", chosen, instructions);
+    printf("  Cluster  Interval  Weight  Intervals  First Instruction\n");
+    for (j = 0; j < chosen; j++) {
+        if (members[j] == 0) continue;
+        printf("  %7d  %8d  %6.4f  %9d  %llu\n", j, point[j], ((double)clusterInstructions[j])/instructions, members[j], first[point[j]]);
+    }
+
+    if (out != NULL) {
+        char name[512];
+        snprintf(name, sizeof(name), "%s.simpoints", out);
+        FILE *simpoints = fopen(name, "w");
+        snprintf(name, sizeof(name), "%s.weights", out);
+        FILE *weights = fopen(name, "w");
+        if (simpoints == NULL || weights == NULL) {
+            printf("Could not write %s.simpoints and %s.weights\n", out, out);
+            return 1;
+        }
+        for (j = 0; j < chosen; j++) {
+            if (members[j] == 0) continue;
+            fprintf(simpoints, "%d %d\n", point[j], j);
+            fprintf(weights, "%.6f %d\n", ((double)clusterInstructions[j])/instructions, j);
+        }
+        fclose(simpoints);
+        fclose(weights);
+    }
+    free(point);
+    free(members);
+    free(clusterInstructions);
+    free(first);
+    free(assign);
+    free(tryAssign);
+    free(centers);
+    free(tryCenters);
+    free(score);
+    free(set.point);
+    free(set.instructions);
+    return 0;
+}
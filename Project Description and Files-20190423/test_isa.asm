@@ -0,0 +1,27 @@
+# The 1-D convolution of test.asm written with the wider ISA
+# for (i=1; i != N-2; i++)
+#    A[i] = B[i-1] + B[i] + B[i+1];
+# The address of A and B are in $s1 and $s2, i and N are in $s3 and $s4 as in test.asm.
+# SLL computes i*4 in one instruction, the loop walks pointers to A[i] and B[i] instead of
+# recomputing them from i, and the loop test moves to the bottom as a BNE on the A pointer,
+# so each iteration runs 9 instructions instead of 13. N must be at least 4.
+
+ADDI, $s3, $s0, 1            # instruction #0, i = 1;
+ADDI, $s4, $s0, 256          # instruction #1, Init N=256
+ADDI, $s4, $s4, -2           # instruction #2, $s4 has N-2
+SLL,  $s11, $s3, 2           # 3, $s11 has i*4
+ADD,  $s5, $s11, $s2         # 4, &B[i] is now in $s5
+ADD,  $s10, $s11, $s1        # 5, &A[i] is now in $s10
+SLL,  $s12, $s4, 2           # 6, (N-2)*4
+ADD,  $s12, $s12, $s1        # 7, &A[N-2], the loop ends when $s10 gets there
+# loop label:   which is instruction 8
+LW,   $s6, $s5, -4           # 8,  B[i-1] is now in $s6
+LW,   $s7, $s5, 0            # 9,  B[i] is now in $s7
+LW,   $s8, $s5, 4            # 10, B[i+1] is now in $s8
+ADD,  $s9, $s6, $s7          # 11, B[i-1] + B[i]
+ADD,  $s9, $s8, $s9          # 12, B[i-1] + B[i] + B[i+1]
+SW,   $s9, $s10, 0           # 13, A[i] stored the result
+ADDI, $s5, $s5, 4            # 14, &B[i+1]
+ADDI, $s10, $s10, 4          # 15, &A[i+1]
+BNE,  $s10, $s12, -9         # 16, back to the loop (instruction 8) while &A[i] != &A[N-2]
+J, 999999                    # 17, terminate the program
@@ -0,0 +1,24 @@
+# The 1-D convolution of test.asm written with register-indexed loads and stores
+# for (i=1; i != N-2; i++)
+#    A[i] = B[i-1] + B[i] + B[i+1];
+# The address of A and B are in $s1 and $s2, i and N are in $s3 and $s4 as in test.asm.
+# $s3 holds the byte offset i*4 and is the only register the loop advances: LWR and SWR add it to
+# the base addresses of A, B-4, B and B+4, so each iteration runs 8 instructions. N must be at least 4.
+
+ADDI, $s3, $s0, 1            # instruction #0, i = 1;
+ADDI, $s4, $s0, 256          # instruction #1, Init N=256
+ADDI, $s4, $s4, -2           # instruction #2, $s4 has N-2
+SLL,  $s3, $s3, 2            # 3, $s3 has i*4
+SLL,  $s12, $s4, 2           # 4, $s12 has (N-2)*4, the loop ends when $s3 gets there
+ADDI, $s5, $s2, -4           # 5, &B[-1] is now in $s5
+ADDI, $s6, $s2, 4            # 6, &B[1] is now in $s6
+# loop label:   which is instruction 7
+LWR,  $s7, $s5, $s3          # 7,  B[i-1] is now in $s7
+LWR,  $s8, $s2, $s3          # 8,  B[i] is now in $s8
+LWR,  $s9, $s6, $s3          # 9,  B[i+1] is now in $s9
+ADD,  $s10, $s7, $s8         # 10, B[i-1] + B[i]
+ADD,  $s10, $s9, $s10        # 11, B[i-1] + B[i] + B[i+1]
+SWR,  $s10, $s1, $s3         # 12, A[i] stored the result
+ADDI, $s3, $s3, 4            # 13, i++
+BNE,  $s3, $s12, -8          # 14, back to the loop (instruction 7) while i != N-2
+J, 999999                    # 15, terminate the program
@@ -0,0 +1,43 @@
+# The 1-D convolution of test.asm written with the vector extension
+# for (i=1; i != N-2; i++)
+#    A[i] = B[i-1] + B[i] + B[i+1];
+# The address of A and B are in $s1 and $s2, i and N are in $s3 and $s4 as in test.asm.
+# The vector loop computes A[i..i+3] = B[i-1..i+2] + B[i..i+3] + B[i+1..i+4] with three VLW,
+# two VADD and one VSW; the (N-3)%4 elements left over are done by the scalar loop of test_isa.asm.
+
+ADDI, $s3, $s0, 1            # instruction #0, i = 1;
+ADDI, $s4, $s0, 256          # instruction #1, Init N=256
+ADDI, $s4, $s4, -2           # instruction #2, $s4 has N-2
+SLL,  $s11, $s3, 2           # 3, $s11 has i*4
+ADD,  $s5, $s11, $s2         # 4, &B[i] is now in $s5
+ADD,  $s10, $s11, $s1        # 5, &A[i] is now in $s10
+SLL,  $s12, $s4, 2           # 6, (N-2)*4
+ADD,  $s12, $s12, $s1        # 7, &A[N-2], the end of A
+ADDI, $s13, $s4, -1          # 8, N-3 elements to compute
+ADDI, $s14, $s0, -4          # 9, ~3
+AND,  $s13, $s13, $s14       # 10, elements done by the vector loop, a multiple of 4
+SLL,  $s13, $s13, 2          # 11, in bytes
+ADD,  $s13, $s13, $s10       # 12, &A[1 + vector elements], the end of the vector loop
+BEQ,  $s10, $s13, 9          # 13, no full vector, go to the scalar loop (instruction 23)
+# vector loop label:   which is instruction 14
+VLW,  $v1, $s5, -4           # 14, B[i-1..i+2]
+VLW,  $v2, $s5, 0            # 15, B[i..i+3]
+VLW,  $v3, $s5, 4            # 16, B[i+1..i+4]
+VADD, $v1, $v1, $v2          # 17
+VADD, $v1, $v1, $v3          # 18
+VSW,  $v1, $s10, 0           # 19, A[i..i+3] stored the result
+ADDI, $s5, $s5, 16           # 20, &B[i+4]
+ADDI, $s10, $s10, 16         # 21, &A[i+4]
+BNE,  $s10, $s13, -9         # 22, back to the vector loop (instruction 14)
+# scalar loop label:   which is instruction 23
+BEQ,  $s10, $s12, 9          # 23, done, go to the end (instruction 33)
+LW,   $s6, $s5, -4           # 24, B[i-1] is now in $s6
+LW,   $s7, $s5, 0            # 25, B[i] is now in $s7
+LW,   $s8, $s5, 4            # 26, B[i+1] is now in $s8
+ADD,  $s9, $s6, $s7          # 27, B[i-1] + B[i]
+ADD,  $s9, $s8, $s9          # 28, B[i-1] + B[i] + B[i+1]
+SW,   $s9, $s10, 0           # 29, A[i] stored the result
+ADDI, $s5, $s5, 4            # 30, &B[i+1]
+ADDI, $s10, $s10, 4          # 31, &A[i+1]
+J, 23                        # 32, back to the scalar loop
+J, 999999                    # 33, terminate the program
@@ -0,0 +1,27 @@
+# The 1-D convolution of test_lwr.asm, after writes to $s0 by an ALU, a shift, a load and an immediate
+# instruction. $s0 is hardwired to 0 in every engine: the writes are dropped, and the loop, which takes
+# its constants from $s0, computes A as test_lwr.asm does. Every engine must pass the verification with
+# the same instruction count. Had the writes gone through, $s0 would be 4 and A would be off by 4.
+# N must be at least 4.
+
+ADD,  $s0, $s1, $s2          # instruction #0, $s0 stays 0
+SLL,  $s0, $s2, 2            # 1, $s0 stays 0
+LW,   $s0, $s2, 4            # 2, $s0 stays 0, B[1] is not written to it
+ADDI, $s0, $s5, 4            # 3, $s0 stays 0 ($s5 is 0 here)
+ADDI, $s3, $s0, 1            # 4, i = 1;
+ADDI, $s4, $s0, 256          # 5, Init N=256
+ADDI, $s4, $s4, -2           # 6, $s4 has N-2
+SLL,  $s3, $s3, 2            # 7, $s3 has i*4
+SLL,  $s12, $s4, 2           # 8, $s12 has (N-2)*4, the loop ends when $s3 gets there
+ADDI, $s5, $s2, -4           # 9, &B[-1] is now in $s5
+ADDI, $s6, $s2, 4            # 10, &B[1] is now in $s6
+# loop label:   which is instruction 11
+LWR,  $s7, $s5, $s3          # 11, B[i-1] is now in $s7
+LWR,  $s8, $s2, $s3          # 12, B[i] is now in $s8
+LWR,  $s9, $s6, $s3          # 13, B[i+1] is now in $s9
+ADD,  $s10, $s7, $s8         # 14, B[i-1] + B[i]
+ADD,  $s10, $s9, $s10        # 15, B[i-1] + B[i] + B[i+1]
+SWR,  $s10, $s1, $s3         # 16, A[i] stored the result
+ADDI, $s3, $s3, 4            # 17, i++
+BNE,  $s3, $s12, -8          # 18, back to the loop (instruction 11) while i != N-2
+J, 999999                    # 19, terminate the program
@@ -0,0 +1,127 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "cputrace.h"
+
+/*
+ * Reader of the compressed binary trace written by cpusim_cachesim --trace-out (the format is in cputrace.h).
+ * Prints the instructions from --from on, one line each, or with --summary the instruction mix, the cache
+ * misses and the size of the trace. --from seeks through the chunk index, only the chunk holding that
+ * instruction is decompressed.
+ *
+ * Build:   the tracereader target of the CMake build
+ * Example: build/cpusim_cachesim test_isa.asm.bin --trace-out isa.ctr
+ *          build/tracereader isa.ctr --from 1000 --count 20
+ */
+
+char *funcName(unsigned int ir) {
+    char *name = FuncNames[ir >> 26];
+    return name ? name : "???";
+}
+
+void printRecord(const struct CTraceRecord *r) {
+    int a;
+    printf("%llu\tPC %u\t%08x %-5s", r->index, r->pc, r->ir, funcName(r->ir));
+    if (r->flags & CTR_IMISS) printf(" I-miss");
+    for (a = 0; a < r->numAccesses; a++) {
+        printf(" %s %u %s", r->access[a].kind & CTR_ACCESS_WRITE ? "D-write" : "D-read", r->access[a].addr,
+               r->access[a].kind & CTR_ACCESS_MISS ? "miss" : "hit");
+    }
+    if (r->flags & CTR_REG_WRITE) printf(" Reg[%d] = %d", r->reg, r->value);
+    if (r->flags & CTR_VREG_WRITE) {
+        printf(" VReg[%d] = %d %d %d %d", r->vreg, r->vvalue[0], r->vvalue[1], r->vvalue[2], r->vvalue[3]);
+    }
+    printf("\n");
+}
+
+void printSummary(struct CTraceReader *reader, const char *fileName) {
+    struct CTraceRecord r;
+    unsigned long long mix[64] = {0};
+    unsigned long long iMiss = 0, reads = 0, writes = 0, readMiss = 0, writeMiss = 0;
+    int a, f;
+    while (ctraceNext(reader, &r)) {
+        mix[r.ir >> 26]++;
+        iMiss += (r.flags & CTR_IMISS) != 0;
+        for (a = 0; a < r.numAccesses; a++) {
+            int miss = (r.access[a].kind & CTR_ACCESS_MISS) != 0;
+            if (r.access[a].kind & CTR_ACCESS_WRITE) {
+                writes++;
+                writeMiss += miss;
+            } else {
+                reads++;
+                readMiss += miss;
+            }
+        }
+    }
+    unsigned long long n = reader->footer.numInstr;
+    fseek(reader->file, 0, SEEK_END);
+    long bytes = ftell(reader->file);
+    printf("%s: %llu instructions in %llu chunks, %ld bytes, %.2f bytes/instruction\n", fileName, n,
+           reader->footer.numChunks, bytes, n ? (double)bytes/n : 0.0);
+    printf("Instruction cache misses: %llu\n", iMiss);
+    printf("Data cache reads: %llu, misses: %llu\n", reads, readMiss);
+    printf("Data cache writes: %llu, misses: %llu\n", writes, writeMiss);
+    printf("Instruction mix:\n");
+    for (f = 0; f < 64; f++) {
+        if (mix[f]) printf("  %-5s %12llu  %6.2f%%\n", FuncNames[f] ? FuncNames[f] : "???", mix[f], 100.0*mix[f]/n);
+    }
+}
+
+void usage() {
+    printf("Usage: tracereader <file> [options]\n"
+           "  --from <n>          start at instruction n, counting from 0 (default 0)\n"
+           "  --count <n>         print at most n instructions (default all)\n"
+           "  --summary <0|1>     print the instruction mix and cache misses instead of the instructions (default 0)\n");
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long from = 0, count = (unsigned long long)-1;
+    int summary = 0;
+    if (argc < 2 || argv[1][0] == '-') {
+        usage();
+        return 1;
+    }
+    int arg;
+    for (arg = 2; arg < argc; arg++) {
+        char *end;
+        if (strncmp(argv[arg], "--", 2) != 0 || arg + 1 == argc) {
+            usage();
+            return 1;
+        }
+        const char *key = argv[arg] + 2;
+        const char *value = argv[++arg];
+        if (strcmp(key, "from") == 0) {
+            from = strtoull(value, &end, 0);
+        } else if (strcmp(key, "count") == 0) {
+            count = strtoull(value, &end, 0);
+        } else if (strcmp(key, "summary") == 0) {
+            summary = (int)strtol(value, &end, 0);
+        } else {
+            end = (char*)value;
+        }
+        if (end == value || *end != '\0') {
+            printf("Invalid option --%s %s\n", key, value);
+            usage();
+            return 1;
+        }
+    }
+
+    struct CTraceReader *reader = ctraceOpen(argv[1], 0);
+    if (reader == NULL) {
+        printf("Could not read trace file %s\n", argv[1]);
+        return 1;
+    }
+    if (summary) {
+        printSummary(reader, argv[1]);
+    } else if (from < reader->footer.numInstr) {
+        struct CTraceRecord r;
+        if (!ctraceSeek(reader, from)) {
+            printf("Could not seek to instruction %llu of %s\n", from, argv[1]);
+            ctraceCloseReader(reader);
+            return 1;
+        }
+        while (count-- > 0 && ctraceNext(reader, &r)) printRecord(&r);
+    }
+    ctraceCloseReader(reader);
+    return 0;
+}
@@ -0,0 +1,26 @@
+# ctest helper: runs cpusim_cachesim twice, with ARGS followed by RUN_A and then by RUN_B, each in its own
+# scratch directory under WORK_DIR, and fails unless the lines of the two cpusim_trace.txt that match the
+# regular expression LINES are the same. The argument lists are separated by commas.
+#
+#   cmake -DSIM=<cpusim_cachesim> -DWORK_DIR=<dir> -DARGS=<a,b,..> -DRUN_A=<..> -DRUN_B=<..> -DLINES=<regex>
+#         -P CompareRuns.cmake
+
+foreach(run A B)
+  string(REPLACE "," ";" args "${ARGS},${RUN_${run}}")
+  set(dir "${WORK_DIR}/${run}")
+  file(MAKE_DIRECTORY "${dir}")
+  execute_process(COMMAND "${SIM}" ${args} WORKING_DIRECTORY "${dir}" RESULT_VARIABLE status OUTPUT_QUIET)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${SIM} ${args} failed: ${status}")
+  endif()
+  file(STRINGS "${dir}/cpusim_trace.txt" lines_${run} REGEX "${LINES}")
+  if(NOT lines_${run})
+    message(FATAL_ERROR "${SIM} ${args}: no line of cpusim_trace.txt matches ${LINES}")
+  endif()
+endforeach()
+
+if(NOT lines_A STREQUAL lines_B)
+  string(REPLACE ";" "\n" a "${lines_A}")
+  string(REPLACE ";" "\n" b "${lines_B}")
+  message(FATAL_ERROR "The runs differ\n${RUN_A}:\n${a}\n${RUN_B}:\n${b}")
+endif()